@@ -0,0 +1,298 @@
+/*
+ * Generic simulated annealing engine shared by the optimisers.
+ *
+ * Annealer<State, Move, Energy, Schedule> runs the Metropolis loop over any
+ * state: it draws a move, scores it with the energy's delta hook before
+ * touching the state, and applies it in place if it is accepted. Every
+ * policy is a template parameter, so the inner loop has no virtual calls
+ * and inlines down to the model's own proposal and delta code.
+ *
+ * Policies (scores are maximised, as everywhere in these programs):
+ *
+ *   Move      void apply(State &) const      apply the move in place
+ *             void undo(State &) const       revert an applied move
+ *   Energy    Move propose(const State &, Rng &) const
+ *             double delta(const State &, const Move &) const   score change if applied
+ *             double score(const State &) const                 full score
+ *   Schedule  see Schedules.h
+ *   Hooks     void beforeStep(Annealer &)
+ *             void afterStep(Annealer &, bool accepted, double delta)
+ *             bool afterIteration(Annealer &)               false stops the run
+ *
+ * Hooks add metrics, checkpoints, rescoring or observers without a cost to
+ * runs that do not use them; NoAnnealHooks compiles to nothing.
+ * runBatched() draws and scores the proposals a batch at a time and needs
+ * two more energy hooks (see there).
+ *
+ * The loop position (iteration, temperature, scores) is public so hooks can
+ * read it and callers can start a run anywhere, e.g. from a checkpoint.
+ * Without a best state only the current one is kept. New bests are checked
+ * on every accepted move, or only every bestInterval iterations.
+ *
+ * The best state is tracked lazily through a journal of the moves accepted
+ * since the best state was last brought up to date: a new best only marks
+ * its position in the journal. The best state is materialised by replaying
+ * the journal up to the mark onto it when the journal is full, when a hook
+ * calls syncBest() (e.g. before a checkpoint) and at the end of the run, at
+ * a cost per move rather than per cell. Only when the journal fills up with
+ * moves made after the best, so that replaying them is no longer possible,
+ * does the next new best fall back to a full copy of the state.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Metropolis.h"
+#include "Random.h"
+
+const int ANNEAL_MAX_BATCH = 64; // Most proposals of a runBatched batch
+
+// Swap of two cells by index, for any grid with swapCells
+struct CellSwap
+{
+    int a;
+    int b;
+
+    template <class State>
+    void apply(State &state) const { state.swapCells(a, b); }
+
+    template <class State>
+    void undo(State &state) const { state.swapCells(a, b); }
+};
+
+// Hooks that do nothing
+struct NoAnnealHooks
+{
+    template <class A>
+    void beforeStep(A &) {}
+
+    template <class A>
+    void afterStep(A &, bool, double) {}
+
+    template <class A>
+    bool afterIteration(A &) { return true; }
+};
+
+template <class State, class Move, class Energy, class Schedule>
+class Annealer
+{
+public:
+    // best may be null to keep only the current state
+    Annealer(State &state, State *best, const Energy &energy, Schedule &schedule, Rng &rng, Metropolis &metropolis)
+        : state_(state), best_(best), energy_(energy), schedule_(schedule), rng_(rng), metropolis_(metropolis)
+    {
+        temperature = schedule.initialTemperature();
+    }
+
+    // Bring the best state up to date with the best point of the run
+    void syncBest()
+    {
+        if (!journalValid_)
+            return;
+        for (int i = 0; i < bestMark_; ++i)
+            journal_[i].apply(*best_);
+        journal_.erase(journal_.begin(), journal_.begin() + bestMark_);
+        bestMark_ = 0;
+    }
+
+    State &state() { return state_; }
+    const Energy &energy() const { return energy_; }
+    const Schedule &schedule() const { return schedule_; }
+    Rng &rng() { return rng_; }
+    Metropolis &metropolis() { return metropolis_; }
+
+    // Run until the schedule ends or a hook stops it. Returns the iteration
+    // the run ended at.
+    template <class Hooks>
+    int64_t run(Hooks &hooks)
+    {
+        return loop(hooks, [this](Move &move, double &delta)
+                    {
+            /*
+            The probability of accepting a new configuration is determined by the Metropolis criterion:
+
+            𝑃 = 𝑒^(Δ𝑆/𝑇)
+
+            ΔS: Change in score (new score minus current score).
+
+            Positive ΔS: The new configuration is better and is always accepted.
+            Negative ΔS: The new configuration is worse; acceptance depends on the temperature.
+            T: Current temperature.
+
+            Metropolis evaluates it as ΔS > T * log(u) with precomputed logs (see Metropolis.h).
+            The move is scored before it is applied, so a rejected move never touches the state.
+            */
+            move = energy_.propose(state_, rng_);
+            delta = energy_.delta(state_, move);
+            return metropolis_.accept(delta, temperature, rng_); });
+    }
+
+    // Run with proposals drawn and scored up to `batchSize` at a time: a
+    // batch of candidates is drawn against the current state and all their
+    // deltas are computed together, so the memory accesses of the batch
+    // overlap and the delta kernel can be vectorised. The candidates are then
+    // tried in order as ordinary Metropolis steps, one per iteration, until
+    // one is accepted; the rest of the batch was scored against the state
+    // before that move and is dropped. Proposals are independent draws, so
+    // dropping unused ones leaves the chain exactly the plain Metropolis
+    // chain.
+    //
+    // The batch size adapts to the acceptance rate: it halves on every
+    // accepted move and doubles, up to batchSize, whenever a whole batch is
+    // rejected. While most moves are accepted the batches stay at one or two
+    // candidates and little work is dropped; at low temperatures nearly every
+    // candidate is tried, the batches grow to batchSize and the cost per
+    // proposal falls to that of the batched kernel.
+    //
+    // Needs, in addition to the policies above,
+    //
+    //   Energy    void proposeBatch(const State &, Rng &, Move *out, int count) const
+    //             void deltas(const State &, const Move *, int count, double *out) const
+    template <class Hooks>
+    int64_t runBatched(Hooks &hooks, int batchSize)
+    {
+        batchMax_ = std::max(1, std::min(batchSize, ANNEAL_MAX_BATCH));
+        Move candidates[ANNEAL_MAX_BATCH];
+        double deltas[ANNEAL_MAX_BATCH];
+        discardBatch();
+        return loop(hooks, [&](Move &move, double &delta)
+                    {
+            if (batchNext_ == batchEnd_)
+            {
+                energy_.proposeBatch(state_, rng_, candidates, batchLimit_);
+                energy_.deltas(state_, candidates, batchLimit_, deltas);
+                batchNext_ = 0;
+                batchEnd_ = batchLimit_;
+            }
+            move = candidates[batchNext_];
+            delta = deltas[batchNext_++];
+            const bool accepted = metropolis_.accept(delta, temperature, rng_);
+            if (accepted)
+            {
+                batchNext_ = batchEnd_ = 0;
+                batchLimit_ = std::max(1, batchLimit_ / 2);
+            }
+            else if (batchNext_ == batchEnd_)
+                batchLimit_ = std::min(batchMax_, batchLimit_ * 2);
+            return accepted; });
+    }
+
+    // Drop the untried candidates of runBatched and restart the batch size
+    // at one, e.g. at a checkpoint, so a run resumed from there draws the
+    // same next batch
+    void discardBatch()
+    {
+        batchNext_ = batchEnd_ = 0;
+        batchLimit_ = 1;
+    }
+
+    int64_t run()
+    {
+        NoAnnealHooks hooks;
+        return run(hooks);
+    }
+
+    // Loop position
+    int64_t iteration = 0;
+    double temperature;
+    double currentScore = 0.0;
+    double bestScore = 0.0;
+    int bestInterval = 1;        // Iterations between best-state checks, 1 = on every accepted move
+    int journalCapacity = 4096;  // Moves journalled before the best state is brought up to date
+
+private:
+    // The annealing loop around a step that proposes a move, sets its delta
+    // and returns whether it is accepted, without touching the state
+    template <class Hooks, class Step>
+    int64_t loop(Hooks &hooks, Step step)
+    {
+        Move move;
+        double delta;
+        while (!schedule_.finished(iteration, temperature))
+        {
+            hooks.beforeStep(*this);
+
+            const bool accepted = step(move, delta);
+            if (accepted)
+            {
+                move.apply(state_);
+                currentScore += delta;
+            }
+            hooks.afterStep(*this, accepted, delta);
+
+            if (accepted && journalValid_)
+                record(move);
+
+            const bool check = bestInterval == 1 ? accepted : (iteration + 1) % bestInterval == 0;
+            const bool newBest = best_ && check && currentScore > bestScore;
+            if (newBest)
+                markBest();
+
+            if (!hooks.afterIteration(*this))
+            {
+                iteration++;
+                break;
+            }
+
+            temperature = schedule_.next(iteration, temperature, accepted, newBest);
+            iteration++;
+        }
+        syncBest();
+        return iteration;
+    }
+
+    void record(const Move &move)
+    {
+        if (static_cast<int>(journal_.size()) == journalCapacity)
+        {
+            syncBest();
+            if (static_cast<int>(journal_.size()) == journalCapacity)
+            {
+                // Every journalled move came after the best: the best state is
+                // up to date, but later ones can no longer be replayed onto it
+                journal_.clear();
+                journalValid_ = false;
+                return;
+            }
+        }
+        journal_.push_back(move);
+    }
+
+    void markBest()
+    {
+        bestScore = currentScore;
+        if (journalValid_)
+        {
+            bestMark_ = static_cast<int>(journal_.size());
+            return;
+        }
+        // The best state is not on the journalled path (start of a run, or
+        // after an overflow): copy once, then journal from here
+        *best_ = state_; // Same-sized copy into existing storage, no allocation
+        if (journal_.capacity() < static_cast<size_t>(journalCapacity))
+            journal_.reserve(journalCapacity);
+        journal_.clear();
+        bestMark_ = 0;
+        journalValid_ = true;
+    }
+
+
+    State &state_;
+    State *best_;
+    const Energy &energy_;
+    Schedule &schedule_;
+    Rng &rng_;
+    Metropolis &metropolis_;
+
+    std::vector<Move> journal_; // Accepted moves since the best state was last brought up to date
+    int bestMark_ = 0;          // Journal length at the best point
+    bool journalValid_ = false; // Whether the best state plus the journal lies on the current path
+
+    int batchNext_ = 0; // Next untried candidate of runBatched
+    int batchEnd_ = 0;
+    int batchLimit_ = 1; // Size of the next batch
+    int batchMax_ = 1;   // Largest batch of the run
+};
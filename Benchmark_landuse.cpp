@@ -0,0 +1,280 @@
+/*
+ * Microbenchmarks for the land use optimiser.
+ *
+ * Runs distance map computation, incremental land use edits, full scoring,
+ * swap delta evaluation, heuristic initialisation and fixed-length anneals
+ * (a cold one also with batched proposals) on synthetic sites
+ * from 16x16 up to 2048x2048 at several land use densities, and reports
+ * ns/op, ops/sec (proposals/sec for the anneal) and the peak resident set
+ * size of the process so far.
+ *
+ * Output is one CSV row (default) or one JSON object per line (--json) per
+ * benchmark, so runs of different versions can be diffed or plotted.
+ *
+ * Usage: Benchmark_landuse [--json] [--max-size N] [--min-time SECONDS] [--seed S]
+ *
+ * The optimiser is compiled in from SimulatedAnnealing_landuse.cpp with its
+ * main() disabled. Enable _MAIN_ here and disable it there to build this
+ * program instead of the optimiser.
+ */
+
+//#define _MAIN_
+#ifdef _MAIN_
+
+#define LANDUSE_NO_MAIN
+#include "SimulatedAnnealing_landuse.cpp"
+
+#include <cstring>
+
+#if defined(_WIN32)
+// Keep windows.h from defining min/max macros, which break std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of this process in kilobytes
+long long peakRssKb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+    return usage.ru_maxrss; // Kilobytes on Linux
+#endif
+#endif
+}
+
+// Synthetic site: a fraction `density` of the cells holds fixed land use
+// types drawn uniformly, the rest is left EMPTY for agents
+Grid<CellType> syntheticSite(int size, double density, Rng &rng)
+{
+    Grid<CellType> grid(size, size, EMPTY);
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (rng.uniform01() < density)
+        {
+            grid.set(idx, landUseTypes[rng.uniform(static_cast<uint32_t>(landUseTypes.size()))]);
+        }
+    }
+    return grid;
+}
+
+struct BenchmarkOptions
+{
+    bool json = false;
+    int maxSize = 2048;
+    double minTime = 0.2; // Seconds each benchmark is repeated for at least
+    uint64_t seed = 1;
+};
+
+struct BenchmarkResult
+{
+    string name;
+    int size;
+    double density;
+    long long ops;
+    double seconds;
+};
+
+void report(const BenchmarkResult &result, const BenchmarkOptions &options)
+{
+    const double nsPerOp = result.seconds * 1e9 / max(result.ops, 1LL);
+    const double opsPerSec = result.seconds > 0 ? result.ops / result.seconds : 0.0;
+    if (options.json)
+    {
+        cout << "{\"benchmark\": \"" << result.name << "\", \"rows\": " << result.size << ", \"cols\": " << result.size
+             << ", \"density\": " << result.density << ", \"ops\": " << result.ops
+             << ", \"ns_per_op\": " << nsPerOp << ", \"ops_per_sec\": " << opsPerSec
+             << ", \"peak_rss_kb\": " << peakRssKb() << "}" << endl;
+    }
+    else
+    {
+        cout << result.name << ',' << result.size << ',' << result.size << ',' << result.density << ','
+             << result.ops << ',' << nsPerOp << ',' << opsPerSec << ',' << peakRssKb() << endl;
+    }
+}
+
+// Repeats body() until minTime has passed; body returns the number of
+// operations it performed
+template <typename Body>
+BenchmarkResult measure(const string &name, int size, double density, double minTime, Body body)
+{
+    BenchmarkResult result = {name, size, density, 0, 0.0};
+    const auto start = steady_clock::now();
+    do
+    {
+        result.ops += body();
+        result.seconds = duration<double>(steady_clock::now() - start).count();
+    } while (result.seconds < minTime);
+    return result;
+}
+
+// Keeps benchmarked results observable so the work is not optimised away
+volatile double benchmarkSink = 0.0;
+
+void benchmarkSite(int size, double density, const BenchmarkOptions &options)
+{
+    Rng rng(options.seed);
+    const map<CellType, double> agentPercentages = {
+        {RESIDENTIAL, 0.45},
+        {OFFICE, 0.25},
+        {COM_SHOP, 0.20},
+        {COM_CAFE, 0.10}};
+
+    const Grid<CellType> site = syntheticSite(size, density, rng);
+
+    DistanceMaps distanceMaps;
+    report(measure("distance_maps", size, density, options.minTime, [&]
+                   {
+                       distanceMaps = computeDistanceMaps(site);
+                       return 1LL;
+                   }),
+           options);
+
+    const UtilityTable utility = computeUtilityTable<StandardScenario>(distanceMaps);
+
+    Grid<CellType> grid = site;
+    report(measure("init_input", size, density, options.minTime, [&]
+                   {
+                       grid = site;
+                       generateGrid_input(grid, agentPercentages, rng);
+                       return 1LL;
+                   }),
+           options);
+
+    Grid<CellType> heuristicGrid = site;
+    report(measure("init_heuristic", size, density, options.minTime, [&]
+                   {
+                       heuristicGrid = site;
+                       generateGrid_heuristic(heuristicGrid, agentPercentages, utility, rng);
+                       return 1LL;
+                   }),
+           options);
+
+    report(measure("full_score", size, density, options.minTime, [&]
+                   {
+                       benchmarkSink = benchmarkSink + calculateScore(grid, utility);
+                       return 1LL;
+                   }),
+           options);
+
+    // Place a TRANSPORT stop at a random cell and take it away again,
+    // patching the distance maps, utility table and score incrementally;
+    // ops are edits
+    {
+        DynamicDistanceMaps dynamicMaps(grid);
+        UtilityTable editUtility = utility;
+        double score = calculateScore(grid, editUtility);
+        report(measure("edit_land_use", size, density, options.minTime, [&]
+                       {
+                           const int idx = rng.uniform(grid.size());
+                           const CellType previous = grid[idx];
+                           score += patchUtility(editUtility, dynamicMaps.maps(), grid, idx, previous, dynamicMaps.setCell(grid, idx, TRANSPORT));
+                           score += patchUtility(editUtility, dynamicMaps.maps(), grid, idx, TRANSPORT, dynamicMaps.setCell(grid, idx, previous));
+                           return 2LL;
+                       }),
+               options);
+        benchmarkSink = benchmarkSink + score;
+    }
+
+    // Swap pairs drawn up front so the benchmark measures swapDelta only
+    const vector<int> agentCells = collectAgentCells(grid);
+    if (!hasMixedAgents(grid, agentCells))
+    {
+        return;
+    }
+    vector<pair<int, int>> swaps(4096);
+    for (pair<int, int> &swap : swaps)
+    {
+        proposeSwap(grid, agentCells, rng, swap.first, swap.second);
+    }
+    report(measure("swap_delta", size, density, options.minTime, [&]
+                   {
+                       double sum = 0.0;
+                       for (const pair<int, int> &swap : swaps)
+                           sum += swapDelta(grid, swap.first, swap.second, utility);
+                       benchmarkSink = benchmarkSink + sum;
+                       return static_cast<long long>(swaps.size());
+                   }),
+           options);
+
+    // Fixed-length anneal of ~46k proposals; ops are proposals
+    report(measure("anneal", size, density, options.minTime, [&]
+                   {
+                       Grid<CellType> annealGrid = grid;
+                       OptimiserMetrics metrics;
+                       optimiseGrid(annealGrid, utility, rng, 10.0, 0.1, 1e-4, 0, nullptr, &metrics);
+                       return static_cast<long long>(metrics.proposals);
+                   }),
+           options);
+
+    // Low temperature anneal of ~46k proposals from the heuristic layout,
+    // where most proposals are rejected, one at a time and batched 16 at a time
+    for (int batchSize : {1, 16})
+    {
+        report(measure(batchSize > 1 ? "anneal_cold_batched" : "anneal_cold", size, density, options.minTime, [&]
+                       {
+                           Grid<CellType> annealGrid = heuristicGrid;
+                           OptimiserMetrics metrics;
+                           optimiseGrid(annealGrid, utility, rng, 0.1, 0.01, 5e-5, 0, nullptr, &metrics, nullptr, batchSize);
+                           return static_cast<long long>(metrics.proposals);
+                       }),
+               options);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            options.json = true;
+        else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+            options.maxSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            options.minTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--json] [--max-size N] [--min-time SECONDS] [--seed S]" << endl;
+            return 1;
+        }
+    }
+
+    if (!options.json)
+    {
+        cout << "benchmark,rows,cols,density,ops,ns_per_op,ops_per_sec,peak_rss_kb" << endl;
+    }
+
+    const int sizes[] = {16, 64, 256, 1024, 2048};
+    const double densities[] = {0.01, 0.05, 0.20};
+    for (int size : sizes)
+    {
+        if (size > options.maxSize)
+            break;
+        for (double density : densities)
+        {
+            benchmarkSite(size, density, options);
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Checkpointing of annealing runs.
+ *
+ * AnnealState is everything an annealing loop needs to continue: the current
+ * and best grids, temperature, iteration, scores, schedule settings, the
+ * RNG state and the position in the Metropolis uniform buffer. A run resumed
+ * from a saved state replays exactly the same proposals and decisions as an
+ * uninterrupted run with the same seed.
+ *
+ * CheckpointWriter saves states from a background thread. The annealer only
+ * copies the state into a pending slot (two grid copies, no I/O); the writer
+ * thread serialises it to "<path>.tmp" and renames it over <path>, so a crash
+ * mid-write never corrupts the previous checkpoint. If the writer is still
+ * busy when a newer state arrives, the older pending state is replaced.
+ *
+ * File layout (little-endian): CheckpointHeader, then rows * cols current
+ * cells, then rows * cols best cells.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Grid.h"
+#include "Metropolis.h"
+#include "Random.h"
+
+const uint32_t CHECKPOINT_VERSION = 3;
+
+template <typename Cell>
+struct AnnealState
+{
+    Grid<Cell> grid;
+    Grid<Cell> bestGrid;
+    int64_t iteration = 0;
+    double temperature = 0.0;
+    double currentScore = 0.0;
+    double bestScore = 0.0;
+
+    // Schedule the run was started with
+    double initialTemperature = 0.0;
+    double cooldown = 0.0;
+    double coolingRate = 0.0;
+    int rescoreInterval = 0;
+    int batchSize = 1; // Proposals drawn and scored together, 1 = one at a time
+
+    uint64_t rngState[4] = {};
+    MetropolisState acceptance;
+};
+
+// Fixed-size header; every field is 8 bytes so the layout has no padding
+struct CheckpointHeader
+{
+    char magic[4]; // "ANCK"
+    uint32_t version;
+    int64_t rows;
+    int64_t cols;
+    int64_t iteration;
+    int64_t rescoreInterval;
+    int64_t batchSize;
+    double temperature;
+    double currentScore;
+    double bestScore;
+    double initialTemperature;
+    double cooldown;
+    double coolingRate;
+    uint64_t rngState[4];
+    uint64_t acceptanceState[4];
+    int64_t acceptancePosition;
+};
+
+template <typename Cell>
+bool saveCheckpoint(const std::string &path, const AnnealState<Cell> &state)
+{
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, "ANCK", 4);
+    header.version = CHECKPOINT_VERSION;
+    header.rows = state.grid.rows();
+    header.cols = state.grid.cols();
+    header.iteration = state.iteration;
+    header.rescoreInterval = state.rescoreInterval;
+    header.batchSize = state.batchSize;
+    header.temperature = state.temperature;
+    header.currentScore = state.currentScore;
+    header.bestScore = state.bestScore;
+    header.initialTemperature = state.initialTemperature;
+    header.cooldown = state.cooldown;
+    header.coolingRate = state.coolingRate;
+    std::memcpy(header.rngState, state.rngState, sizeof(header.rngState));
+    std::memcpy(header.acceptanceState, state.acceptance.refillState, sizeof(header.acceptanceState));
+    header.acceptancePosition = state.acceptance.position;
+
+    const std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(state.grid.data()), state.grid.size());
+        out.write(reinterpret_cast<const char *>(state.bestGrid.data()), state.bestGrid.size());
+        if (!out.flush())
+            return false;
+    }
+    std::remove(path.c_str()); // rename does not replace existing files on Windows
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// Loads a checkpoint written by saveCheckpoint. The header is checked before
+// anything is allocated, and every cell must be below numCellTypes.
+template <typename Cell>
+bool loadCheckpoint(const std::string &path, AnnealState<Cell> &state, int numCellTypes, std::string &error)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    const std::streamoff fileSize = in ? static_cast<std::streamoff>(in.tellg()) : 0;
+    in.seekg(0);
+    CheckpointHeader header;
+    if (!in || !in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    {
+        error = "cannot read checkpoint " + path;
+        return false;
+    }
+    if (std::memcmp(header.magic, "ANCK", 4) != 0 || header.version != CHECKPOINT_VERSION)
+    {
+        error = path + " is not a version " + std::to_string(CHECKPOINT_VERSION) + " checkpoint";
+        return false;
+    }
+
+    if (header.rows <= 0 || header.cols <= 0 || header.rows > INT32_MAX / header.cols)
+    {
+        error = "checkpoint " + path + " has invalid dimensions";
+        return false;
+    }
+    if (header.batchSize < 1)
+    {
+        error = "checkpoint " + path + " has an invalid batch size";
+        return false;
+    }
+    if (header.acceptancePosition < 0 || header.acceptancePosition > METROPOLIS_BATCH)
+    {
+        error = "checkpoint " + path + " has an invalid Metropolis buffer position";
+        return false;
+    }
+    const int rows = static_cast<int>(header.rows);
+    const int cols = static_cast<int>(header.cols);
+    const std::streamoff cells = std::streamoff(rows) * cols;
+    if (fileSize != std::streamoff(sizeof(header)) + 2 * cells)
+    {
+        error = "checkpoint " + path + " is truncated or has trailing data";
+        return false;
+    }
+
+    state.grid = Grid<Cell>(rows, cols);
+    state.bestGrid = Grid<Cell>(rows, cols);
+    in.read(reinterpret_cast<char *>(state.grid.data()), state.grid.size());
+    in.read(reinterpret_cast<char *>(state.bestGrid.data()), state.bestGrid.size());
+    if (!in)
+    {
+        error = "checkpoint " + path + " is truncated";
+        return false;
+    }
+    for (const Grid<Cell> *grid : {&state.grid, &state.bestGrid})
+    {
+        const uint8_t *data = grid->data();
+        for (int idx = 0; idx < grid->size(); ++idx)
+        {
+            if (data[idx] >= numCellTypes)
+            {
+                error = "checkpoint " + path + " has a cell outside the cell types";
+                return false;
+            }
+        }
+    }
+
+    state.iteration = header.iteration;
+    state.rescoreInterval = static_cast<int>(header.rescoreInterval);
+    state.batchSize = static_cast<int>(header.batchSize);
+    state.temperature = header.temperature;
+    state.currentScore = header.currentScore;
+    state.bestScore = header.bestScore;
+    state.initialTemperature = header.initialTemperature;
+    state.cooldown = header.cooldown;
+    state.coolingRate = header.coolingRate;
+    std::memcpy(state.rngState, header.rngState, sizeof(state.rngState));
+    std::memcpy(state.acceptance.refillState, header.acceptanceState, sizeof(state.acceptance.refillState));
+    state.acceptance.position = static_cast<int>(header.acceptancePosition);
+    return true;
+}
+
+// Saves annealing states every `interval` iterations (at least 1) on a
+// background thread
+template <typename Cell>
+class CheckpointWriter
+{
+public:
+    CheckpointWriter(const std::string &path, int interval)
+        : path_(path), interval_(std::max(interval, 1)), thread_([this] { run(); })
+    {
+    }
+
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+    // Writes the last submitted state before returning
+    ~CheckpointWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    int interval() const { return interval_; }
+    const std::string &path() const { return path_; }
+
+    // Hand a snapshot to the writer thread; only copies the state
+    void submit(const AnnealState<Cell> &state)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = state;
+            hasPending_ = true;
+        }
+        wake_.notify_one();
+    }
+
+    // Block until every submitted state has been written
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return !hasPending_ && !writing_; });
+    }
+
+    int written() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return written_;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this] { return hasPending_ || stop_; });
+            if (!hasPending_)
+                break;
+
+            std::swap(writingState_, pending_);
+            hasPending_ = false;
+            writing_ = true;
+            lock.unlock();
+            const bool ok = saveCheckpoint(path_, writingState_);
+            lock.lock();
+            writing_ = false;
+            written_ += ok ? 1 : 0;
+            idle_.notify_all();
+        }
+    }
+
+    const std::string path_;
+    const int interval_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    AnnealState<Cell> pending_;
+    AnnealState<Cell> writingState_;
+    bool hasPending_ = false;
+    bool writing_ = false;
+    bool stop_ = false;
+    int written_ = 0;
+
+    std::thread thread_; // Last member, so it starts after everything above is constructed
+};
@@ -0,0 +1,164 @@
+/*
+ * Flat grid of cell types shared by the simulated annealing programs.
+ *
+ * Cells are stored row-major in a single contiguous uint8_t buffer and
+ * the dimensions are runtime properties of the grid, so one build handles
+ * any site size. Moves are applied in place (swapCells), which lets the
+ * annealers run without allocating or copying grids per iteration.
+ *
+ * A grid normally owns its cells. Grid::view() instead wraps external
+ * memory, e.g. a memory-mapped site file, without copying it. Copies of a
+ * view own their cells, and assigning (copy or move) a same-sized grid to a
+ * view writes through to the viewed memory.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+template <typename Cell>
+class Grid
+{
+public:
+    Grid() = default;
+
+    Grid(int rows, int cols, Cell fill = Cell())
+        : rows_(rows), cols_(cols), storage_(static_cast<size_t>(rows) * cols, static_cast<uint8_t>(fill)), cells_(storage_.data())
+    {
+    }
+
+    // Build from a nested literal, e.g. grid = {{EMPTY, ROAD}, {ROAD, EMPTY}}
+    Grid(std::initializer_list<std::initializer_list<Cell>> rows)
+        : rows_(static_cast<int>(rows.size())), cols_(rows.size() ? static_cast<int>(rows.begin()->size()) : 0)
+    {
+        storage_.reserve(static_cast<size_t>(rows_) * cols_);
+        for (const auto &row : rows)
+            for (Cell cell : row)
+                storage_.push_back(static_cast<uint8_t>(cell));
+        cells_ = storage_.data();
+    }
+
+    // Non-owning grid over rows * cols cells at `cells`, which must outlive it
+    static Grid view(uint8_t *cells, int rows, int cols)
+    {
+        Grid grid;
+        grid.rows_ = rows;
+        grid.cols_ = cols;
+        grid.cells_ = cells;
+        return grid;
+    }
+
+    Grid(const Grid &other)
+        : rows_(other.rows_), cols_(other.cols_), storage_(other.cells_, other.cells_ + other.size()), cells_(storage_.data())
+    {
+    }
+
+    Grid(Grid &&other) noexcept { *this = std::move(other); }
+
+    Grid &operator=(const Grid &other)
+    {
+        if (this == &other)
+            return *this;
+        if (isView() && rows_ == other.rows_ && cols_ == other.cols_)
+        {
+            std::copy(other.cells_, other.cells_ + other.size(), cells_); // Write through to the viewed memory
+            return *this;
+        }
+        rows_ = other.rows_;
+        cols_ = other.cols_;
+        storage_.assign(other.cells_, other.cells_ + other.size());
+        cells_ = storage_.data();
+        return *this;
+    }
+
+    Grid &operator=(Grid &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        if (isView() && rows_ == other.rows_ && cols_ == other.cols_)
+            return *this = static_cast<const Grid &>(other);
+        rows_ = other.rows_;
+        cols_ = other.cols_;
+        const bool otherIsView = other.isView();
+        storage_ = std::move(other.storage_);
+        cells_ = otherIsView ? other.cells_ : storage_.data();
+        other.rows_ = other.cols_ = 0;
+        other.cells_ = nullptr;
+        return *this;
+    }
+
+    // Whether the cells live in external memory rather than in the grid
+    bool isView() const { return cells_ != nullptr && cells_ != storage_.data(); }
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    int size() const { return rows_ * cols_; }
+
+    // Row-major index of cell (i, j)
+    int index(int i, int j) const { return i * cols_ + j; }
+
+    Cell operator()(int i, int j) const { return static_cast<Cell>(cells_[index(i, j)]); }
+    Cell operator[](int idx) const { return static_cast<Cell>(cells_[idx]); }
+
+    void set(int i, int j, Cell cell) { cells_[index(i, j)] = static_cast<uint8_t>(cell); }
+    void set(int idx, Cell cell) { cells_[idx] = static_cast<uint8_t>(cell); }
+
+    // Exchange the contents of two cells in place
+    void swapCells(int a, int b) { std::swap(cells_[a], cells_[b]); }
+
+    void fill(Cell cell) { std::fill(cells_, cells_ + size(), static_cast<uint8_t>(cell)); }
+
+    const uint8_t *data() const { return cells_; }
+    uint8_t *data() { return cells_; }
+
+    // Bytes of cell storage owned by the grid (0 for a view)
+    size_t memoryBytes() const { return storage_.capacity(); }
+
+    bool operator==(const Grid &other) const
+    {
+        return rows_ == other.rows_ && cols_ == other.cols_ && std::equal(cells_, cells_ + size(), other.cells_);
+    }
+    bool operator!=(const Grid &other) const { return !(*this == other); }
+
+private:
+    int rows_ = 0;
+    int cols_ = 0;
+    std::vector<uint8_t> storage_; // Cells of an owning grid, empty for a view
+    uint8_t *cells_ = nullptr;     // storage_.data() or the viewed memory
+};
+
+// Runs Kernel<N, N>::run(args...) for the square sizes N = 12, 16, 20, 32
+// and 64 used by small interactive sites, and the runtime-sized
+// Kernel<0, 0>::run(args...) otherwise. Kernels read their dimensions as
+// FIXED_ROWS > 0 ? FIXED_ROWS : rows, so the fixed sizes get constant trip
+// counts and strides the compiler can fully unroll, while both paths execute
+// the same code and produce identical results.
+template <template <int, int> class Kernel, typename... Args>
+auto dispatchGridSize(int rows, int cols, Args &&...args) -> decltype(Kernel<0, 0>::run(std::forward<Args>(args)...))
+{
+    if (rows == cols)
+    {
+        switch (rows)
+        {
+        case 12: return Kernel<12, 12>::run(std::forward<Args>(args)...);
+        case 16: return Kernel<16, 16>::run(std::forward<Args>(args)...);
+        case 20: return Kernel<20, 20>::run(std::forward<Args>(args)...);
+        case 32: return Kernel<32, 32>::run(std::forward<Args>(args)...);
+        case 64: return Kernel<64, 64>::run(std::forward<Args>(args)...);
+        default: break;
+        }
+    }
+    return Kernel<0, 0>::run(std::forward<Args>(args)...);
+}
+
+// Whether dispatchGridSize has a specialised kernel for the size, i.e. does
+// not fall back to Kernel<0, 0>
+inline bool isDispatchedGridSize(int rows, int cols)
+{
+    return rows == cols && (rows == 12 || rows == 16 || rows == 20 || rows == 32 || rows == 64);
+}
@@ -0,0 +1,404 @@
+/*
+ * Binary site file format with a memory-mapped loader.
+ *
+ * A site file holds everything needed to set up an optimisation: the grid
+ * dimensions, a dictionary naming every cell value, the agent and land use
+ * types, their preference table and the raw row-major uint8_t cells. The
+ * cell payload starts at a 64-byte aligned offset, so SiteFile maps the file
+ * and hands out a Grid view over the payload without parsing or copying it.
+ * The mapping is private (copy-on-write): edits made through the view, e.g.
+ * by a grid generator, never reach the file.
+ *
+ * Layout (little-endian):
+ *   SiteFileHeader
+ *   typeCount x char[SITE_TYPE_NAME_LENGTH]   name of each cell value
+ *   agentCount x uint8_t                      agent type codes
+ *   landUseCount x uint8_t                    land use type codes
+ *   (padding to 4 bytes)
+ *   agentCount x landUseCount x float         preferences, agent-major
+ *   (padding to 64 bytes)
+ *   rows x cols x uint8_t                     cells, at payloadOffset
+ *
+ * importSiteCsv converts text exports (one grid row per line, cells given by
+ * dictionary name or numeric code) into this format in a single streaming
+ * pass, so sites larger than memory can be converted once.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Grid.h"
+
+#if defined(_WIN32)
+// Keep windows.h from defining min/max macros, which break std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const int SITE_TYPE_NAME_LENGTH = 16;
+const uint32_t SITE_FILE_VERSION = 1;
+
+struct SiteFileHeader
+{
+    char magic[4]; // "SITE"
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t typeCount;
+    uint32_t agentCount;
+    uint32_t landUseCount;
+    uint32_t reserved;
+    uint64_t payloadOffset;
+};
+
+// Everything in a site file except the cells
+struct SiteDescription
+{
+    std::vector<std::string> typeNames; // Name of each cell value
+    std::vector<uint8_t> agentTypes;
+    std::vector<uint8_t> landUseTypes;
+    std::vector<float> preferences; // preferences[a * landUseTypes.size() + k]
+
+    // Cell value with the given name, or -1
+    int typeCode(const std::string &name) const
+    {
+        for (size_t t = 0; t < typeNames.size(); ++t)
+        {
+            if (typeNames[t] == name)
+                return static_cast<int>(t);
+        }
+        return -1;
+    }
+};
+
+// Byte offsets of the sections that follow the header
+struct SiteFileLayout
+{
+    size_t agents, landUses, preferences, payload;
+
+    explicit SiteFileLayout(size_t typeCount, size_t agentCount, size_t landUseCount)
+    {
+        agents = sizeof(SiteFileHeader) + typeCount * SITE_TYPE_NAME_LENGTH;
+        landUses = agents + agentCount;
+        preferences = (landUses + landUseCount + 3) & ~size_t(3);
+        payload = (preferences + agentCount * landUseCount * sizeof(float) + 63) & ~size_t(63);
+    }
+};
+
+// Read-only file mapped with private copy-on-write pages
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path)
+    {
+        close();
+#if defined(_WIN32)
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (!mapping_)
+        {
+            close();
+            return false;
+        }
+        data_ = static_cast<uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_COPY, 0, 0, 0));
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        void *address = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps the file referenced
+        data_ = address == MAP_FAILED ? nullptr : static_cast<uint8_t *>(address);
+#endif
+        if (!data_)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#if defined(_WIN32)
+        if (data_)
+            UnmapViewOfFile(data_);
+        if (mapping_)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_)
+            munmap(data_, size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+// A mapped site file. The description is decoded on open (it is tiny); the
+// cells stay in the mapping and are accessed through grid().
+class SiteFile
+{
+public:
+    bool open(const std::string &path, std::string &error)
+    {
+        if (!file_.open(path))
+        {
+            error = "cannot map " + path;
+            return false;
+        }
+        if (file_.size() < sizeof(SiteFileHeader))
+        {
+            error = path + " is too small to be a site file";
+            return false;
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, "SITE", 4) != 0 || header_.version != SITE_FILE_VERSION)
+        {
+            error = path + " is not a version " + std::to_string(SITE_FILE_VERSION) + " site file";
+            return false;
+        }
+
+        // Cells are bytes and grids are indexed by int
+        const uint64_t cells = uint64_t(header_.rows) * header_.cols;
+        if (header_.typeCount > 256 || cells > uint64_t(INT32_MAX))
+        {
+            error = path + " has more than 256 cell types or more than 2^31 - 1 cells";
+            return false;
+        }
+
+        const SiteFileLayout layout(header_.typeCount, header_.agentCount, header_.landUseCount);
+        if (header_.payloadOffset != layout.payload || file_.size() < layout.payload + cells)
+        {
+            error = path + " is truncated or has an inconsistent layout";
+            return false;
+        }
+
+        const uint8_t *bytes = file_.data();
+        description_ = SiteDescription();
+        for (uint32_t t = 0; t < header_.typeCount; ++t)
+        {
+            const char *name = reinterpret_cast<const char *>(bytes + sizeof(SiteFileHeader) + t * SITE_TYPE_NAME_LENGTH);
+            description_.typeNames.emplace_back(name, strnlen(name, SITE_TYPE_NAME_LENGTH));
+        }
+        description_.agentTypes.assign(bytes + layout.agents, bytes + layout.agents + header_.agentCount);
+        description_.landUseTypes.assign(bytes + layout.landUses, bytes + layout.landUses + header_.landUseCount);
+        for (const std::vector<uint8_t> *codes : {&description_.agentTypes, &description_.landUseTypes})
+        {
+            for (uint8_t code : *codes)
+            {
+                if (code >= header_.typeCount)
+                {
+                    error = path + " names type code " + std::to_string(code) + " outside its dictionary";
+                    return false;
+                }
+            }
+        }
+        description_.preferences.resize(size_t(header_.agentCount) * header_.landUseCount);
+        if (!description_.preferences.empty())
+        {
+            std::memcpy(description_.preferences.data(), bytes + layout.preferences, description_.preferences.size() * sizeof(float));
+        }
+        return true;
+    }
+
+    int rows() const { return static_cast<int>(header_.rows); }
+    int cols() const { return static_cast<int>(header_.cols); }
+    const SiteDescription &description() const { return description_; }
+
+    // Cell payload inside the mapping
+    uint8_t *cells() const { return file_.data() + header_.payloadOffset; }
+
+    // Grid view over the mapped cells, valid while this SiteFile is open
+    template <typename Cell>
+    Grid<Cell> grid() const
+    {
+        return Grid<Cell>::view(cells(), rows(), cols());
+    }
+
+private:
+    MappedFile file_;
+    SiteFileHeader header_ = {};
+    SiteDescription description_;
+};
+
+namespace site_file_detail
+{
+inline void writeHeaderAndDescription(std::ofstream &out, const SiteDescription &description, uint32_t rows, uint32_t cols)
+{
+    const SiteFileLayout layout(description.typeNames.size(), description.agentTypes.size(), description.landUseTypes.size());
+
+    SiteFileHeader header = {};
+    std::memcpy(header.magic, "SITE", 4);
+    header.version = SITE_FILE_VERSION;
+    header.rows = rows;
+    header.cols = cols;
+    header.typeCount = static_cast<uint32_t>(description.typeNames.size());
+    header.agentCount = static_cast<uint32_t>(description.agentTypes.size());
+    header.landUseCount = static_cast<uint32_t>(description.landUseTypes.size());
+    header.payloadOffset = layout.payload;
+
+    std::vector<char> prefix(layout.payload, 0);
+    std::memcpy(prefix.data(), &header, sizeof(header));
+    for (size_t t = 0; t < description.typeNames.size(); ++t)
+    {
+        std::strncpy(prefix.data() + sizeof(header) + t * SITE_TYPE_NAME_LENGTH, description.typeNames[t].c_str(), SITE_TYPE_NAME_LENGTH);
+    }
+    std::copy(description.agentTypes.begin(), description.agentTypes.end(), prefix.begin() + layout.agents);
+    std::copy(description.landUseTypes.begin(), description.landUseTypes.end(), prefix.begin() + layout.landUses);
+    if (!description.preferences.empty())
+    {
+        std::memcpy(prefix.data() + layout.preferences, description.preferences.data(), description.preferences.size() * sizeof(float));
+    }
+
+    out.seekp(0);
+    out.write(prefix.data(), static_cast<std::streamsize>(prefix.size()));
+}
+} // namespace site_file_detail
+
+// Write a grid and its description as a site file
+template <typename Cell>
+bool writeSiteFile(const std::string &path, const Grid<Cell> &grid, const SiteDescription &description, std::string &error)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+    site_file_detail::writeHeaderAndDescription(out, description, grid.rows(), grid.cols());
+    out.write(reinterpret_cast<const char *>(grid.data()), grid.size());
+    if (!out)
+    {
+        error = "write to " + path + " failed";
+        return false;
+    }
+    return true;
+}
+
+// Convert a text grid to a site file in one streaming pass. Each non-empty
+// line is a grid row; cells are separated by commas or whitespace and given
+// by dictionary name or numeric code. An empty field is cell value 0.
+inline bool importSiteCsv(const std::string &csvPath, const std::string &sitePath, const SiteDescription &description, std::string &error)
+{
+    std::ifstream in(csvPath);
+    if (!in)
+    {
+        error = "cannot open " + csvPath;
+        return false;
+    }
+    std::ofstream out(sitePath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        error = "cannot create " + sitePath;
+        return false;
+    }
+
+    // Placeholder header, rewritten once the dimensions are known
+    site_file_detail::writeHeaderAndDescription(out, description, 0, 0);
+
+    uint32_t rows = 0, cols = 0;
+    std::string line, token;
+    std::vector<uint8_t> row;
+    while (std::getline(in, line))
+    {
+        row.clear();
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue; // Blank line
+
+        // Fields are comma separated if the line has a comma, else whitespace separated
+        const bool commaSeparated = line.find(',') != std::string::npos;
+        const char *separators = commaSeparated ? "," : " \t\r";
+        for (size_t start = 0; start <= line.size();)
+        {
+            size_t end = line.find_first_of(separators, start);
+            if (end == std::string::npos)
+                end = line.size();
+            const size_t first = line.find_first_not_of(" \t\r", start);
+            token = first < end ? line.substr(first, line.find_last_not_of(" \t\r", end - 1) - first + 1) : std::string();
+            start = end + 1;
+            if (token.empty() && !commaSeparated)
+                continue;
+
+            int code = 0;
+            if (!token.empty())
+            {
+                char *tail = nullptr;
+                const long value = std::strtol(token.c_str(), &tail, 10);
+                code = *tail == '\0' ? static_cast<int>(value) : description.typeCode(token);
+            }
+            if (code < 0 || code >= static_cast<int>(description.typeNames.size()))
+            {
+                error = csvPath + ":" + std::to_string(rows + 1) + ": unknown cell type '" + token + "'";
+                return false;
+            }
+            row.push_back(static_cast<uint8_t>(code));
+        }
+
+        if (row.empty())
+            continue;
+        if (rows == 0)
+            cols = static_cast<uint32_t>(row.size());
+        if (row.size() != cols)
+        {
+            error = csvPath + ":" + std::to_string(rows + 1) + ": expected " + std::to_string(cols) + " cells, found " + std::to_string(row.size());
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(row.data()), cols);
+        ++rows;
+    }
+
+    site_file_detail::writeHeaderAndDescription(out, description, rows, cols);
+    if (!out)
+    {
+        error = "write to " + sitePath + " failed";
+        return false;
+    }
+    return true;
+}
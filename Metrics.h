@@ -0,0 +1,210 @@
+/*
+ * Low-overhead metrics for the optimisers.
+ *
+ * An OptimiserMetrics block collects move counters, per-phase wall times and
+ * an optional trace of samples taken every `sampleInterval` iterations. The
+ * optimiser only increments integers per iteration; the clock is read at
+ * phase boundaries and sample points, never per move. Results are read from
+ * the struct directly or exported with writeCsv/writeJson at the end.
+ *
+ * Define ANNEAL_METRICS to 0 to compile all recording out: the macros below
+ * expand to nothing and the counters stay at zero, so callers need no #ifdefs.
+ *
+ * MemoryReport lists the bytes held by each data structure of a run, for
+ * sizing jobs on large sites.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef ANNEAL_METRICS
+#define ANNEAL_METRICS 1
+#endif
+
+// Phases of an optimisation run that are timed separately
+enum MetricsPhase
+{
+    PHASE_DISTANCE_MAPS,
+    PHASE_UTILITY,
+    PHASE_INIT,
+    PHASE_ANNEAL,
+    NUM_PHASES
+};
+
+inline const char *phaseName(MetricsPhase phase)
+{
+    static const char *names[NUM_PHASES] = {"distance_maps", "utility", "init", "anneal"};
+    return names[phase];
+}
+
+// One point of the optimisation trace
+struct MetricsSample
+{
+    int64_t iteration;
+    double temperature;
+    double currentScore;
+    double bestScore;
+    double seconds; // Since the start of the anneal phase
+};
+
+struct OptimiserMetrics
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Move counters. Scores are maximised, so an uphill move is one that
+    // lowers the score (uphill in energy) and a downhill move one that raises it.
+    uint64_t proposals = 0;
+    uint64_t acceptedUphill = 0;
+    uint64_t acceptedDownhill = 0;
+    uint64_t rescores = 0;
+    double maxDrift = 0.0; // Largest |exact - accumulated| score seen at a rescore
+
+    double phaseSeconds[NUM_PHASES] = {};
+
+    int sampleInterval = 0; // Iterations between samples, 0 = no trace
+    std::vector<MetricsSample> samples;
+
+    uint64_t accepted() const { return acceptedUphill + acceptedDownhill; }
+
+    double acceptanceRate() const { return proposals ? double(accepted()) / proposals : 0.0; }
+
+    // Move evaluations per second of the anneal phase
+    double evaluationsPerSecond() const
+    {
+        return phaseSeconds[PHASE_ANNEAL] > 0.0 ? proposals / phaseSeconds[PHASE_ANNEAL] : 0.0;
+    }
+
+    void recordStep(bool accepted, double delta)
+    {
+        ++proposals;
+        if (accepted)
+        {
+            if (delta < 0)
+                ++acceptedUphill;
+            else
+                ++acceptedDownhill;
+        }
+    }
+
+    void recordRescore(double drift)
+    {
+        ++rescores;
+        if (drift < 0)
+            drift = -drift;
+        if (drift > maxDrift)
+            maxDrift = drift;
+    }
+
+    void recordSample(int64_t iteration, double temperature, double currentScore, double bestScore)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - annealStart).count();
+        samples.push_back({iteration, temperature, currentScore, bestScore, seconds});
+    }
+
+    void beginPhase(MetricsPhase phase)
+    {
+        phaseStart[phase] = Clock::now();
+        if (phase == PHASE_ANNEAL)
+            annealStart = phaseStart[phase];
+    }
+
+    void endPhase(MetricsPhase phase)
+    {
+        phaseSeconds[phase] += std::chrono::duration<double>(Clock::now() - phaseStart[phase]).count();
+    }
+
+    // Sample trace as CSV, one row per sample
+    void writeCsv(std::ostream &out) const
+    {
+        out << "iteration,temperature,current_score,best_score,seconds\n";
+        for (const MetricsSample &s : samples)
+        {
+            out << s.iteration << ',' << s.temperature << ',' << s.currentScore << ','
+                << s.bestScore << ',' << s.seconds << '\n';
+        }
+    }
+
+    // Counters, phase times and the sample trace as one JSON object
+    void writeJson(std::ostream &out) const
+    {
+        out << "{\n  \"proposals\": " << proposals
+            << ",\n  \"accepted_uphill\": " << acceptedUphill
+            << ",\n  \"accepted_downhill\": " << acceptedDownhill
+            << ",\n  \"acceptance_rate\": " << acceptanceRate()
+            << ",\n  \"evaluations_per_second\": " << evaluationsPerSecond()
+            << ",\n  \"rescores\": " << rescores
+            << ",\n  \"max_drift\": " << maxDrift
+            << ",\n  \"phase_seconds\": {";
+        for (int p = 0; p < NUM_PHASES; ++p)
+        {
+            out << (p ? ", " : "") << '"' << phaseName(static_cast<MetricsPhase>(p)) << "\": " << phaseSeconds[p];
+        }
+        out << "},\n  \"samples\": [";
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const MetricsSample &s = samples[i];
+            out << (i ? ",\n    " : "\n    ") << "[" << s.iteration << ", " << s.temperature << ", "
+                << s.currentScore << ", " << s.bestScore << ", " << s.seconds << "]";
+        }
+        out << (samples.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+
+private:
+    Clock::time_point phaseStart[NUM_PHASES] = {};
+    Clock::time_point annealStart = {};
+};
+
+// Bytes used per data structure
+struct MemoryReport
+{
+    std::vector<std::pair<std::string, size_t>> entries;
+
+    void add(const std::string &name, size_t bytes) { entries.emplace_back(name, bytes); }
+
+    size_t total() const
+    {
+        size_t sum = 0;
+        for (const auto &entry : entries)
+            sum += entry.second;
+        return sum;
+    }
+
+    // One "name: bytes (MiB)" line per structure and the total
+    void write(std::ostream &out) const
+    {
+        for (const auto &entry : entries)
+            out << entry.first << ": " << entry.second << " bytes (" << entry.second / 1048576.0 << " MiB)\n";
+        out << "total: " << total() << " bytes (" << total() / 1048576.0 << " MiB)\n";
+    }
+};
+
+// Recording macros; `metrics` is an OptimiserMetrics pointer that may be null
+#if ANNEAL_METRICS
+#define METRICS_STEP(metrics, accepted, delta) \
+    do { if (metrics) (metrics)->recordStep((accepted), (delta)); } while (0)
+#define METRICS_RESCORE(metrics, drift) \
+    do { if (metrics) (metrics)->recordRescore(drift); } while (0)
+#define METRICS_SAMPLE(metrics, iteration, temperature, currentScore, bestScore)                    \
+    do {                                                                                            \
+        if ((metrics) && (metrics)->sampleInterval > 0 && (iteration) % (metrics)->sampleInterval == 0) \
+            (metrics)->recordSample((iteration), (temperature), (currentScore), (bestScore));       \
+    } while (0)
+#define METRICS_BEGIN(metrics, phase) \
+    do { if (metrics) (metrics)->beginPhase(phase); } while (0)
+#define METRICS_END(metrics, phase) \
+    do { if (metrics) (metrics)->endPhase(phase); } while (0)
+#else
+// sizeof keeps the arguments referenced without evaluating them
+#define METRICS_STEP(metrics, accepted, delta) do { (void)sizeof((accepted), (delta)); } while (0)
+#define METRICS_RESCORE(metrics, drift) do { (void)sizeof(drift); } while (0)
+#define METRICS_SAMPLE(metrics, iteration, temperature, currentScore, bestScore) do { } while (0)
+#define METRICS_BEGIN(metrics, phase) do { } while (0)
+#define METRICS_END(metrics, phase) do { } while (0)
+#endif
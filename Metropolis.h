@@ -0,0 +1,119 @@
+/*
+ * Metropolis acceptance test without exp() in the annealing loop.
+ *
+ * A move that lowers the score by -delta is accepted with probability
+ * exp(delta / T), i.e. when exp(delta / T) > u for a uniform u. Taking logs,
+ * that is delta > T * log(u), so the test becomes one multiply and one
+ * compare against log(u). The logs are computed a batch at a time into a
+ * buffer, which keeps the transcendental work out of the dependent chain of
+ * the loop and lets the compiler vectorise it. The accepted moves follow the
+ * same distribution as the exp() form; only the order in which the uniforms
+ * are drawn from the Rng changes.
+ *
+ * Define ANNEAL_FAST_EXP to 1 to test fastExp(delta / T) > u instead, with a
+ * buffer of plain uniforms. fastExp is a polynomial approximation with a
+ * relative error below 1e-7, far below the resolution that matters to an
+ * acceptance probability.
+ *
+ * Uniforms are only consumed for moves that do not raise the score, like
+ * the `delta > 0 || exp(delta / T) > u` form this replaces.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "Random.h"
+
+#ifndef ANNEAL_FAST_EXP
+#define ANNEAL_FAST_EXP 0
+#endif
+
+const int METROPOLIS_BATCH = 256;
+
+// exp(x) for x <= 0 via 2^x = 2^n * 2^f, with a degree 7 polynomial for 2^f
+inline double fastExp(double x)
+{
+    if (x < -708.0)
+        return 0.0;
+    const double t = x * 1.4426950408889634; // log2(e)
+    const double n = std::floor(t + 0.5);
+    const double f = t - n; // [-0.5, 0.5]
+    double p = 1.5252733804059841e-5;
+    p = p * f + 1.5403530393381610e-4;
+    p = p * f + 1.3333558146428443e-3;
+    p = p * f + 9.6181291076284772e-3;
+    p = p * f + 5.5504108664821580e-2;
+    p = p * f + 2.4022650695910071e-1;
+    p = p * f + 6.9314718055994531e-1;
+    p = p * f + 1.0;
+    uint64_t bits;
+    std::memcpy(&bits, &p, sizeof(bits));
+    bits += static_cast<uint64_t>(static_cast<int64_t>(n)) << 52; // Scale by 2^n
+    std::memcpy(&p, &bits, sizeof(p));
+    return p;
+}
+
+// Where a Metropolis buffer stands, so a run can be checkpointed and resumed
+// with the same acceptance draws. The buffer itself is not stored: it is
+// regenerated from the Rng state it was filled from.
+struct MetropolisState
+{
+    uint64_t refillState[4] = {};
+    int position = METROPOLIS_BATCH; // Buffered draws used, METROPOLIS_BATCH = none left
+};
+
+class Metropolis
+{
+public:
+    Metropolis() = default;
+
+    // Continue from a saved state
+    explicit Metropolis(const MetropolisState &state) : state_(state)
+    {
+        if (state_.position < METROPOLIS_BATCH)
+        {
+            Rng replay;
+            replay.setState(state_.refillState);
+            fill(replay);
+        }
+    }
+
+    // Whether to accept a move that changes the score by delta at temperature T
+    bool accept(double delta, double temperature, Rng &rng)
+    {
+        if (delta > 0)
+            return true;
+        if (state_.position == METROPOLIS_BATCH)
+        {
+            rng.getState(state_.refillState);
+            fill(rng);
+            state_.position = 0;
+        }
+        const double draw = buffer_[state_.position++];
+#if ANNEAL_FAST_EXP
+        return fastExp(delta / temperature) > draw;
+#else
+        return delta > temperature * draw;
+#endif
+    }
+
+    const MetropolisState &state() const { return state_; }
+
+private:
+    void fill(Rng &rng)
+    {
+        // Uniforms in (0, 1], so log never sees 0
+        for (double &draw : buffer_)
+            draw = ((rng.next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+#if !ANNEAL_FAST_EXP
+        for (double &draw : buffer_)
+            draw = std::log(draw);
+#endif
+    }
+
+    MetropolisState state_;
+    double buffer_[METROPOLIS_BATCH];
+};
@@ -0,0 +1,125 @@
+/*
+ * Small, fast and seedable random number generator (xoshiro256**).
+ *
+ * Replaces rand()/srand() so that every run is reproducible from its seed
+ * and there is no hidden global state: each optimiser or worker thread
+ * owns an Rng and passes it explicitly. Independent streams for parallel
+ * workers are derived with jump(), which advances the state by 2^128 draws.
+ *
+ * Rng satisfies UniformRandomBitGenerator, so it also works with
+ * std::shuffle and the <random> distributions.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+class Rng
+{
+public:
+    using result_type = uint64_t;
+
+    explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+    // Expand a 64-bit seed into the full state with splitmix64
+    void reseed(uint64_t seed)
+    {
+        for (uint64_t &word : s_)
+        {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next()
+    {
+        const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+
+        return result;
+    }
+
+    result_type operator()() { return next(); }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~uint64_t(0); }
+
+    // Unbiased integer in [0, bound) using Lemire's multiply-shift method
+    uint32_t uniform(uint32_t bound)
+    {
+        uint64_t m = (next() >> 32) * bound;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < bound)
+        {
+            const uint32_t threshold = (0u - bound) % bound;
+            while (low < threshold)
+            {
+                m = (next() >> 32) * bound;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+    // Uniform double in [0, 1) with 53 random bits
+    double uniform01() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // Advance the state by 2^128 draws, giving a non-overlapping stream
+    void jump()
+    {
+        static const uint64_t JUMP[] = {0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull,
+                                        0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull};
+        uint64_t t[4] = {0, 0, 0, 0};
+        for (uint64_t word : JUMP)
+        {
+            for (int b = 0; b < 64; ++b)
+            {
+                if (word & (uint64_t(1) << b))
+                {
+                    for (int k = 0; k < 4; ++k)
+                        t[k] ^= s_[k];
+                }
+                next();
+            }
+        }
+        for (int k = 0; k < 4; ++k)
+            s_[k] = t[k];
+    }
+
+    // The index-th independent stream of a seed, e.g. one per worker thread
+    static Rng stream(uint64_t seed, int index)
+    {
+        Rng rng(seed);
+        for (int i = 0; i < index; ++i)
+            rng.jump();
+        return rng;
+    }
+
+    // Full generator state, e.g. for checkpoints; restoring it continues the
+    // stream exactly where it was saved
+    void getState(uint64_t state[4]) const
+    {
+        for (int k = 0; k < 4; ++k)
+            state[k] = s_[k];
+    }
+
+    void setState(const uint64_t state[4])
+    {
+        for (int k = 0; k < 4; ++k)
+            s_[k] = state[k];
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t s_[4];
+};
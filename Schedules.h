@@ -0,0 +1,221 @@
+/*
+ * Cooling schedules for the annealers.
+ *
+ * A schedule decides when a run ends and how the temperature moves between
+ * iterations. It is a template parameter of the annealing loop, so the
+ * per-iteration calls are inlined rather than dispatched virtually. Every
+ * schedule provides:
+ *
+ *   double initialTemperature() const
+ *   bool finished(int64_t iteration, double temperature)
+ *   double next(int64_t iteration, double temperature, bool accepted, bool newBest)
+ *   double progress(int64_t iteration, double temperature) const   // 0..1
+ *
+ * Iterations are 64-bit: long runs make billions of proposals.
+ *
+ * The loop keeps the best layout found throughout, so whichever way a
+ * schedule ends the run (deadline, budget, cooldown) the best result is
+ * returned.
+ *
+ * - GeometricSchedule: T *= 1 - coolingRate until T <= cooldown.
+ * - DeadlineSchedule: geometric cooling from T0 to cooldown timed to end at a
+ *   wall-clock deadline. The cooling rate is re-derived from the measured
+ *   proposal rate at regular checks, so the schedule fits the time budget on
+ *   any machine and site size.
+ * - AdaptiveSchedule: drives the measured acceptance ratio along a target
+ *   that decays geometrically over a fixed number of iterations.
+ * - Reheating<Base>: wraps any schedule and raises the temperature when the
+ *   best score has not improved for a number of iterations.
+ * - ConstantSchedule: a fixed temperature for a fixed number of iterations,
+ *   e.g. one sweep of a tempering replica or one phase of a tiled anneal.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+class GeometricSchedule
+{
+public:
+    GeometricSchedule(double temperature, double cooldown, double coolingRate)
+        : temperature_(temperature), cooldown_(cooldown), coolingRate_(coolingRate),
+          length_(std::max(std::log(cooldown / temperature) / std::log(1 - coolingRate), 1.0))
+    {
+    }
+
+    double initialTemperature() const { return temperature_; }
+    bool finished(int64_t, double temperature) const { return temperature <= cooldown_; }
+    double next(int64_t, double temperature, bool, bool) const { return temperature * (1 - coolingRate_); }
+    double progress(int64_t iteration, double) const { return std::min(iteration / length_, 1.0); }
+
+private:
+    double temperature_;
+    double cooldown_;
+    double coolingRate_;
+    double length_; // Iterations until cooldown
+};
+
+class DeadlineSchedule
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Anneal from temperature to cooldown in `seconds` of wall-clock time,
+    // measured from the first call to finished()
+    DeadlineSchedule(double temperature, double cooldown, double seconds, int checkInterval = 256)
+        : temperature_(temperature), cooldown_(cooldown), seconds_(seconds), checkInterval_(std::max(checkInterval, 1))
+    {
+    }
+
+    double initialTemperature() const { return temperature_; }
+
+    bool finished(int64_t iteration, double temperature)
+    {
+        if (!started_)
+        {
+            started_ = true;
+            start_ = Clock::now();
+            startIteration_ = lastCheckIteration_ = iteration;
+            return false;
+        }
+        if (iteration - lastCheckIteration_ < checkInterval_)
+            return false;
+
+        lastCheckIteration_ = iteration;
+        elapsed_ = std::chrono::duration<double>(Clock::now() - start_).count();
+        if (elapsed_ >= seconds_)
+            return true;
+
+        // Re-derive the cooling rate so T reaches cooldown at the deadline
+        // given the proposal rate observed so far
+        const double rate = (iteration - startIteration_) / std::max(elapsed_, 1e-9);
+        const double remaining = std::max(rate * (seconds_ - elapsed_), 1.0);
+        coolingRate_ = temperature > cooldown_ ? 1 - std::pow(cooldown_ / temperature, 1.0 / remaining) : 0.0;
+        return false;
+    }
+
+    // Holds the temperature until the first check has measured the proposal
+    // rate, and at cooldown if it gets there before the deadline
+    double next(int64_t, double temperature, bool, bool) const
+    {
+        return std::max(temperature * (1 - coolingRate_), cooldown_);
+    }
+
+    double progress(int64_t, double) const { return std::min(elapsed_ / seconds_, 1.0); }
+
+private:
+    double temperature_;
+    double cooldown_;
+    double seconds_;
+    int checkInterval_;
+
+    bool started_ = false;
+    Clock::time_point start_;
+    int64_t startIteration_ = 0;
+    int64_t lastCheckIteration_ = 0;
+    double elapsed_ = 0.0;
+    double coolingRate_ = 0.0;
+};
+
+class ConstantSchedule
+{
+public:
+    ConstantSchedule(double temperature, int64_t iterations) : temperature_(temperature), iterations_(iterations) {}
+
+    double initialTemperature() const { return temperature_; }
+    bool finished(int64_t iteration, double) const { return iteration >= iterations_; }
+    double next(int64_t, double temperature, bool, bool) const { return temperature; }
+    double progress(int64_t iteration, double) const { return iterations_ > 0 ? std::min(double(iteration) / iterations_, 1.0) : 1.0; }
+
+private:
+    double temperature_;
+    int64_t iterations_;
+};
+
+class AdaptiveSchedule
+{
+public:
+    // Run `iterations` steps while steering the acceptance ratio, measured
+    // over windows of `window` proposals, from startAcceptance down to
+    // endAcceptance
+    AdaptiveSchedule(double temperature, int64_t iterations, double startAcceptance = 0.5, double endAcceptance = 0.005, int window = 500)
+        : temperature_(temperature), iterations_(std::max<int64_t>(iterations, 1)), startAcceptance_(startAcceptance),
+          endAcceptance_(endAcceptance), window_(std::max(window, 1))
+    {
+    }
+
+    double initialTemperature() const { return temperature_; }
+    bool finished(int64_t iteration, double) const { return iteration >= iterations_; }
+
+    double next(int64_t iteration, double temperature, bool accepted, bool)
+    {
+        accepted_ += accepted ? 1 : 0;
+        if (++proposals_ < window_)
+            return temperature;
+
+        // For a typical uphill move d, acceptance ~ exp(-d / T), so the
+        // temperature giving the target ratio is T * log(ratio) / log(target)
+        const double target = startAcceptance_ * std::pow(endAcceptance_ / startAcceptance_, double(iteration) / iterations_);
+        const double ratio = std::min(std::max(double(accepted_) / proposals_, 1.0 / (proposals_ + 1)), 0.999);
+        const double factor = std::log(ratio) / std::log(std::min(target, 0.999));
+        accepted_ = proposals_ = 0;
+        return temperature * std::min(std::max(factor, 0.5), 2.0);
+    }
+
+    double progress(int64_t iteration, double) const { return std::min(double(iteration) / iterations_, 1.0); }
+
+private:
+    double temperature_;
+    int64_t iterations_;
+    double startAcceptance_;
+    double endAcceptance_;
+    int window_;
+
+    int accepted_ = 0;
+    int proposals_ = 0;
+};
+
+template <class Base>
+class Reheating
+{
+public:
+    // After stallIterations without a new best, multiply the temperature by
+    // reheatFactor (capped at the initial temperature), at most maxReheats times
+    explicit Reheating(const Base &base, int64_t stallIterations = 20000, double reheatFactor = 10.0, int maxReheats = 5)
+        : base_(base), stallIterations_(stallIterations), reheatFactor_(reheatFactor), maxReheats_(maxReheats)
+    {
+    }
+
+    double initialTemperature() const { return base_.initialTemperature(); }
+    bool finished(int64_t iteration, double temperature) { return base_.finished(iteration, temperature); }
+
+    double next(int64_t iteration, double temperature, bool accepted, bool newBest)
+    {
+        if (newBest)
+            lastBest_ = iteration;
+        double nextTemperature = base_.next(iteration, temperature, accepted, newBest);
+        if (iteration - lastBest_ >= stallIterations_ && reheats_ < maxReheats_)
+        {
+            nextTemperature = std::min(nextTemperature * reheatFactor_, base_.initialTemperature());
+            lastBest_ = iteration;
+            ++reheats_;
+        }
+        return nextTemperature;
+    }
+
+    double progress(int64_t iteration, double temperature) const { return base_.progress(iteration, temperature); }
+
+    int reheats() const { return reheats_; }
+
+private:
+    Base base_;
+    int64_t stallIterations_;
+    double reheatFactor_;
+    int maxReheats_;
+
+    int64_t lastBest_ = 0;
+    int reheats_ = 0;
+};
@@ -0,0 +1,211 @@
+/*
+ * Interactive re-optimisation service for the land use optimiser.
+ *
+ * Keeps one OptimiserSession resident and reads commands from stdin, one
+ * per line, answering each on stdout, so a design tool can drive it through
+ * a pipe. Every reply is a single line starting with "ok" or "error"; the
+ * grid command prints the rows of the layout before its "ok" line.
+ *
+ *   site <path>                      load a .site file (or a .csv, converted to <path>.site)
+ *   new <rows> <cols>                start from an empty site
+ *   set <row> <col> <TYPE>           change a fixed cell to a land use type or EMPTY
+ *   mix <AGENT> <share> ...          set the agent percentages
+ *   pref <AGENT> <LAND_USE> <value>  set a preference
+ *   optimise [milliseconds]          re-anneal from the current layout
+ *   score                            report the current score
+ *   grid                             print the layout
+ *   quit
+ *
+ * Edits do not re-anneal by themselves, so several can be batched before
+ * one optimise. Types are given by their names, e.g. "set 4 7 TRANSPORT".
+ *
+ * Usage: Session_landuse [seed]
+ *
+ * The optimiser is compiled in from SimulatedAnnealing_landuse.cpp with its
+ * main() disabled. Enable _MAIN_ here and disable it there to build this
+ * program instead of the optimiser.
+ */
+
+//#define _MAIN_
+#ifdef _MAIN_
+
+#define LANDUSE_NO_MAIN
+#include "SimulatedAnnealing_landuse.cpp"
+
+#include <memory>
+#include <sstream>
+
+// Function to look up a cell type by name
+bool parseCellType(const string &name, CellType &type)
+{
+    auto it = find(begin(cellTypeNames), end(cellTypeNames), name);
+    if (it == end(cellTypeNames))
+    {
+        return false;
+    }
+    type = static_cast<CellType>(it - begin(cellTypeNames));
+    return true;
+}
+
+// Function to load a site file, importing it first if it is a .csv export
+bool loadSiteGrid(string sitePath, Grid<CellType> &grid, string &error)
+{
+    if (sitePath.size() > 4 && sitePath.compare(sitePath.size() - 4, 4, ".csv") == 0)
+    {
+        const string csvPath = sitePath;
+        sitePath += ".site";
+        if (!importSiteCsv(csvPath, sitePath, siteDescription(), error))
+        {
+            return false;
+        }
+    }
+
+    SiteFile siteFile;
+    Grid<CellType> view;
+    if (!siteFile.open(sitePath, error) || !loadSite(siteFile, view, error))
+    {
+        return false;
+    }
+    grid = view; // Owning copy, so the file can be closed
+    return true;
+}
+
+void reply(const SessionResult &result)
+{
+    cout << "ok score " << result.score << " iterations " << result.iterations
+         << " ms " << result.seconds * 1000.0 << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    const uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : static_cast<uint64_t>(time(0));
+
+    map<CellType, double> agentPercentages = {
+        {RESIDENTIAL, 0.45},
+        {OFFICE, 0.25},
+        {COM_SHOP, 0.20},
+        {COM_CAFE, 0.10}};
+
+    unique_ptr<OptimiserSession> session;
+    string line;
+    while (getline(cin, line))
+    {
+        istringstream in(line);
+        string command;
+        if (!(in >> command))
+        {
+            continue;
+        }
+
+        string error;
+        if (command == "quit")
+        {
+            cout << "ok" << endl;
+            break;
+        }
+        else if (command == "site" || command == "new")
+        {
+            Grid<CellType> site;
+            if (command == "site")
+            {
+                string path;
+                if (!(in >> path) || !loadSiteGrid(path, site, error))
+                {
+                    cout << "error " << (error.empty() ? "usage: site <path>" : error) << endl;
+                    continue;
+                }
+            }
+            else
+            {
+                int rows = 0, cols = 0;
+                if (!(in >> rows >> cols) || rows <= 0 || cols <= 0)
+                {
+                    cout << "error usage: new <rows> <cols>" << endl;
+                    continue;
+                }
+                site = Grid<CellType>(rows, cols, EMPTY);
+            }
+            const auto start = steady_clock::now();
+            session.reset(new OptimiserSession(site, agentPercentages, seed));
+            reply({session->score(), 0, duration<double>(steady_clock::now() - start).count()});
+        }
+        else if (!session)
+        {
+            cout << "error no site loaded" << endl;
+        }
+        else if (command == "set")
+        {
+            int row = -1, col = -1;
+            string name;
+            CellType type;
+            if (!(in >> row >> col >> name) || !parseCellType(name, type))
+                cout << "error usage: set <row> <col> <TYPE>" << endl;
+            else if (row < 0 || row >= session->layout().rows() || col < 0 || col >= session->layout().cols())
+                cout << "error cell outside the site" << endl;
+            else if (!session->setFixedCell(session->layout().index(row, col), type, error))
+                cout << "error " << error << endl;
+            else
+                cout << "ok score " << session->score() << endl;
+        }
+        else if (command == "mix")
+        {
+            map<CellType, double> shares;
+            string name;
+            double share;
+            bool valid = true;
+            while (in >> name >> share)
+            {
+                CellType type;
+                if (!parseCellType(name, type))
+                {
+                    valid = false;
+                    break;
+                }
+                shares[type] = share;
+            }
+            if (!valid || shares.empty())
+                cout << "error usage: mix <AGENT> <share> ..." << endl;
+            else if (!session->setAgentPercentages(shares, error))
+                cout << "error " << error << endl;
+            else
+            {
+                agentPercentages = shares; // Also used for the next site
+                cout << "ok score " << session->score() << endl;
+            }
+        }
+        else if (command == "pref")
+        {
+            string agentName, landUseName;
+            float preference;
+            CellType agentType, landUseType;
+            if (!(in >> agentName >> landUseName >> preference) || !parseCellType(agentName, agentType) || !parseCellType(landUseName, landUseType))
+                cout << "error usage: pref <AGENT> <LAND_USE> <value>" << endl;
+            else if (!session->setPreference(agentType, landUseType, preference, error))
+                cout << "error " << error << endl;
+            else
+                cout << "ok score " << session->score() << endl;
+        }
+        else if (command == "optimise")
+        {
+            double milliseconds;
+            reply(in >> milliseconds ? session->optimise(milliseconds / 1000.0) : session->optimise());
+        }
+        else if (command == "score")
+        {
+            cout << "ok score " << session->score() << endl;
+        }
+        else if (command == "grid")
+        {
+            printGrid(session->layout());
+            cout << "ok" << endl;
+        }
+        else
+        {
+            cout << "error unknown command " << command << endl;
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,488 @@
+/*
+ * Vectorised full-grid scoring kernels with runtime CPU dispatch.
+ *
+ * Two kernels are provided, each with a scalar reference implementation
+ * that the vector paths are tested against:
+ *
+ * - gatherScore: sum of table[cells[i] * numCells + i] over all cells, i.e.
+ *   the land use score read from a per-type utility table. The x86 paths use
+ *   masked gathers (AVX2: 4 lanes, AVX-512: 8 lanes) that skip cell types
+ *   whose table rows are known to be zero; NEON has no gather instruction and
+ *   uses paired loads instead.
+ *
+ * - pairTableScore: sum of lut[a * 4 + b] over all horizontal and vertical
+ *   neighbour pairs (a, b) of a grid with at most 4 cell types, i.e. the
+ *   adjacency score. A row is compared with itself shifted by one cell and
+ *   with the row below, 32 (AVX2) or 16 (NEON) cells at a time, using a byte
+ *   shuffle as the 16-entry lookup table.
+ *
+ *   pairOffsetScore generalises it to the pairs of cells at any offset
+ *   (di, dj) from each other, one term of a wider neighbourhood stencil.
+ *
+ * - swapDeltas: score changes of a batch of cell swaps against the same
+ *   utility table, for batched annealing proposals. Every delta is
+ *   independent, so the AVX2 path evaluates 4 swaps per iteration with
+ *   gathers and the loads of a batch overlap instead of forming a chain of
+ *   dependent cache misses.
+ *
+ * The x86 gathers index the table with 32-bit lanes, so tables of more than
+ * 2^31 - 1 entries (about 238M cells at 9 cell types) take the scalar path.
+ *
+ * The vector paths sum in a different order than the scalar reference, so
+ * floating point results agree to rounding, integer results exactly. The
+ * swap deltas are computed in the same order in every path and agree
+ * exactly.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Instruction sets the kernels can dispatch to
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_NEON_LEVEL,
+    SIMD_AVX2_LEVEL,
+    SIMD_AVX512_LEVEL
+};
+
+// Best instruction set supported by this CPU, detected once
+inline SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = []
+    {
+#if defined(SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return SIMD_SCALAR;
+        __cpuid(info, 1);
+        const bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+        if (!osAvx)
+            return SIMD_SCALAR;
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6)
+            return SIMD_AVX512_LEVEL;
+        if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+            return SIMD_AVX2_LEVEL;
+        return SIMD_SCALAR;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return SIMD_AVX512_LEVEL;
+        if (__builtin_cpu_supports("avx2"))
+            return SIMD_AVX2_LEVEL;
+        return SIMD_SCALAR;
+#endif
+#elif defined(SIMD_NEON)
+        return SIMD_NEON_LEVEL;
+#else
+        return SIMD_SCALAR;
+#endif
+    }();
+    return level;
+}
+
+// Whether every index type * numCells + i below numTypes rows fits the
+// 32-bit index lanes of the x86 gathers
+inline bool gatherIndicesFit(int numTypes, int numCells)
+{
+    return static_cast<int64_t>(numTypes) * numCells <= INT32_MAX;
+}
+
+// ---------------------------------------------------------------------------
+// Gather kernel: sum of table[cells[i] * numCells + i]
+// activeTypes has bit t set if row t of the table may be non-zero; cells of
+// other types are skipped (their contribution is zero by definition).
+// ---------------------------------------------------------------------------
+
+inline double gatherScoreScalar(const uint8_t *cells, const double *table, int numCells, uint32_t activeTypes)
+{
+    double total = 0.0;
+    for (int i = 0; i < numCells; ++i)
+    {
+        if (activeTypes & (1u << cells[i]))
+            total += table[static_cast<size_t>(cells[i]) * numCells + i];
+    }
+    return total;
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET_AVX2 inline double gatherScoreAvx2(const uint8_t *cells, const double *table, int numCells, uint32_t activeTypes)
+{
+    const __m128i stride = _mm_set1_epi32(numCells);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i active = _mm_set1_epi32(static_cast<int>(activeTypes));
+    const __m128i one = _mm_set1_epi32(1);
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+
+    int i = 0;
+    for (; i + 8 <= numCells; i += 8)
+    {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cells + i));
+        const __m128i types0 = _mm_cvtepu8_epi32(bytes);
+        const __m128i types1 = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4));
+        const __m128i idx0 = _mm_add_epi32(_mm_mullo_epi32(types0, stride), _mm_add_epi32(lane, _mm_set1_epi32(i)));
+        const __m128i idx1 = _mm_add_epi32(_mm_mullo_epi32(types1, stride), _mm_add_epi32(lane, _mm_set1_epi32(i + 4)));
+
+        // Lanes whose type bit is set in activeTypes
+        const __m128i on0 = _mm_cmpgt_epi32(_mm_and_si128(_mm_sllv_epi32(one, types0), active), _mm_setzero_si128());
+        const __m128i on1 = _mm_cmpgt_epi32(_mm_and_si128(_mm_sllv_epi32(one, types1), active), _mm_setzero_si128());
+
+        sum0 = _mm256_add_pd(sum0, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, idx0, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(on0)), 8));
+        sum1 = _mm256_add_pd(sum1, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, idx1, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(on1)), 8));
+    }
+
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, _mm256_add_pd(sum0, sum1));
+    double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < numCells; ++i)
+    {
+        if (activeTypes & (1u << cells[i]))
+            total += table[static_cast<size_t>(cells[i]) * numCells + i];
+    }
+    return total;
+}
+
+SIMD_TARGET_AVX512 inline double gatherScoreAvx512(const uint8_t *cells, const double *table, int numCells, uint32_t activeTypes)
+{
+    const __m256i stride = _mm256_set1_epi32(numCells);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i active = _mm256_set1_epi32(static_cast<int>(activeTypes));
+    const __m256i one = _mm256_set1_epi32(1);
+    __m512d sum = _mm512_setzero_pd();
+
+    int i = 0;
+    for (; i + 8 <= numCells; i += 8)
+    {
+        const __m256i types = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(cells + i)));
+        const __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(types, stride), _mm256_add_epi32(lane, _mm256_set1_epi32(i)));
+        const __m256i on = _mm256_and_si256(_mm256_sllv_epi32(one, types), active);
+        const __mmask8 mask = static_cast<__mmask8>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(on, _mm256_setzero_si256()))));
+
+        sum = _mm512_add_pd(sum, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), mask, idx, table, 8));
+    }
+
+    alignas(64) double lanes[8];
+    _mm512_store_pd(lanes, sum);
+    double total = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+    for (; i < numCells; ++i)
+    {
+        if (activeTypes & (1u << cells[i]))
+            total += table[static_cast<size_t>(cells[i]) * numCells + i];
+    }
+    return total;
+}
+#endif
+
+#if defined(SIMD_NEON)
+inline double gatherScoreNeon(const uint8_t *cells, const double *table, int numCells, uint32_t activeTypes)
+{
+    float64x2_t sum0 = vdupq_n_f64(0.0), sum1 = vdupq_n_f64(0.0);
+    auto value = [&](int i)
+    {
+        return (activeTypes & (1u << cells[i])) ? table[static_cast<size_t>(cells[i]) * numCells + i] : 0.0;
+    };
+
+    int i = 0;
+    for (; i + 4 <= numCells; i += 4)
+    {
+        const double pair0[2] = {value(i), value(i + 1)};
+        const double pair1[2] = {value(i + 2), value(i + 3)};
+        sum0 = vaddq_f64(sum0, vld1q_f64(pair0));
+        sum1 = vaddq_f64(sum1, vld1q_f64(pair1));
+    }
+
+    double total = vaddvq_f64(vaddq_f64(sum0, sum1));
+    for (; i < numCells; ++i)
+        total += value(i);
+    return total;
+}
+#endif
+
+// Dispatching entry point of the gather kernel
+inline double gatherScore(const uint8_t *cells, const double *table, int numCells, uint32_t activeTypes)
+{
+    // Only the rows of active types are gathered from
+    int numTypes = 0;
+    while (numTypes < 32 && (activeTypes >> numTypes) != 0)
+        ++numTypes;
+    if (!gatherIndicesFit(numTypes, numCells))
+        return gatherScoreScalar(cells, table, numCells, activeTypes);
+
+    switch (detectSimdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX512_LEVEL: return gatherScoreAvx512(cells, table, numCells, activeTypes);
+    case SIMD_AVX2_LEVEL: return gatherScoreAvx2(cells, table, numCells, activeTypes);
+#endif
+#if defined(SIMD_NEON)
+    case SIMD_NEON_LEVEL: return gatherScoreNeon(cells, table, numCells, activeTypes);
+#endif
+    default: return gatherScoreScalar(cells, table, numCells, activeTypes);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Pair kernel: sum of lut[a * 4 + b] over horizontal pairs (row[j], row[j + 1])
+// and vertical pairs (row[j], below[j]). Cell values must be below 4.
+// ---------------------------------------------------------------------------
+
+inline long long pairTableScoreScalar(const uint8_t *cells, int rows, int cols, const int8_t lut[16])
+{
+    long long total = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const uint8_t *row = cells + static_cast<size_t>(i) * cols;
+        for (int j = 0; j + 1 < cols; ++j)
+            total += lut[row[j] * 4 + row[j + 1]];
+        if (i + 1 < rows)
+        {
+            const uint8_t *below = row + cols;
+            for (int j = 0; j < cols; ++j)
+                total += lut[row[j] * 4 + below[j]];
+        }
+    }
+    return total;
+}
+
+#if defined(SIMD_X86)
+// Sum of lut[a * 4 + b] over n lanes of a and b
+SIMD_TARGET_AVX2 inline long long pairSpanAvx2(const uint8_t *a, const uint8_t *b, int n, const int8_t lut[16])
+{
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lut)));
+    const __m256i onesU8 = _mm256_set1_epi8(1);
+    const __m256i onesI16 = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + j));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+        const __m256i idx = _mm256_or_si256(_mm256_slli_epi16(va, 2), vb); // a * 4 + b, values < 16 per byte
+        const __m256i scores = _mm256_shuffle_epi8(table, idx);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(onesU8, scores), onesI16));
+    }
+
+    alignas(32) int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sum);
+    long long total = 0;
+    for (int32_t value : lanes)
+        total += value;
+    for (; j < n; ++j)
+        total += lut[a[j] * 4 + b[j]];
+    return total;
+}
+
+SIMD_TARGET_AVX2 inline long long pairTableScoreAvx2(const uint8_t *cells, int rows, int cols, const int8_t lut[16])
+{
+    long long total = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const uint8_t *row = cells + static_cast<size_t>(i) * cols;
+        total += pairSpanAvx2(row, row + 1, cols - 1, lut);
+        if (i + 1 < rows)
+            total += pairSpanAvx2(row, row + cols, cols, lut);
+    }
+    return total;
+}
+#endif
+
+#if defined(SIMD_NEON)
+inline long long pairSpanNeon(const uint8_t *a, const uint8_t *b, int n, const int8_t lut[16])
+{
+    const uint8x16_t table = vreinterpretq_u8_s8(vld1q_s8(lut));
+    int32x4_t sum = vdupq_n_s32(0);
+
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        const uint8x16_t idx = vorrq_u8(vshlq_n_u8(vld1q_u8(a + j), 2), vld1q_u8(b + j));
+        const int8x16_t scores = vreinterpretq_s8_u8(vqtbl1q_u8(table, idx));
+        sum = vpadalq_s16(sum, vpaddlq_s8(scores));
+    }
+
+    long long total = vaddvq_s32(sum);
+    for (; j < n; ++j)
+        total += lut[a[j] * 4 + b[j]];
+    return total;
+}
+
+inline long long pairTableScoreNeon(const uint8_t *cells, int rows, int cols, const int8_t lut[16])
+{
+    long long total = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        const uint8_t *row = cells + static_cast<size_t>(i) * cols;
+        total += pairSpanNeon(row, row + 1, cols - 1, lut);
+        if (i + 1 < rows)
+            total += pairSpanNeon(row, row + cols, cols, lut);
+    }
+    return total;
+}
+#endif
+
+// Dispatching entry point of the pair kernel
+inline long long pairTableScore(const uint8_t *cells, int rows, int cols, const int8_t lut[16])
+{
+    switch (detectSimdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX512_LEVEL:
+    case SIMD_AVX2_LEVEL: return pairTableScoreAvx2(cells, rows, cols, lut);
+#endif
+#if defined(SIMD_NEON)
+    case SIMD_NEON_LEVEL: return pairTableScoreNeon(cells, rows, cols, lut);
+#endif
+    default: return pairTableScoreScalar(cells, rows, cols, lut);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Offset pair kernel: sum of lut[a * 4 + b] over all pairs of cells
+// a = (i, j), b = (i + di, j + dj) inside the grid, for di >= 0. The pairs
+// of one row are a contiguous span of that row and of row i + di, so the
+// spans of the pair kernel above do the work.
+// ---------------------------------------------------------------------------
+
+template <typename Span>
+inline long long pairOffsetSweep(const uint8_t *cells, int rows, int cols, int di, int dj, Span span)
+{
+    const int first = dj < 0 ? -dj : 0;
+    const int last = dj > 0 ? cols - dj : cols;
+    if (last <= first)
+        return 0;
+    long long total = 0;
+    for (int i = 0; i + di < rows; ++i)
+    {
+        const uint8_t *row = cells + static_cast<size_t>(i) * cols;
+        total += span(row + first, row + static_cast<size_t>(di) * cols + dj + first, last - first);
+    }
+    return total;
+}
+
+inline long long pairOffsetScoreScalar(const uint8_t *cells, int rows, int cols, int di, int dj, const int8_t lut[16])
+{
+    return pairOffsetSweep(cells, rows, cols, di, dj, [&](const uint8_t *a, const uint8_t *b, int n)
+                           {
+        long long total = 0;
+        for (int j = 0; j < n; ++j)
+            total += lut[a[j] * 4 + b[j]];
+        return total; });
+}
+
+// Dispatching entry point of the offset pair kernel
+inline long long pairOffsetScore(const uint8_t *cells, int rows, int cols, int di, int dj, const int8_t lut[16])
+{
+    switch (detectSimdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX512_LEVEL:
+    case SIMD_AVX2_LEVEL:
+        return pairOffsetSweep(cells, rows, cols, di, dj, [&](const uint8_t *a, const uint8_t *b, int n)
+                               { return pairSpanAvx2(a, b, n, lut); });
+#endif
+#if defined(SIMD_NEON)
+    case SIMD_NEON_LEVEL:
+        return pairOffsetSweep(cells, rows, cols, di, dj, [&](const uint8_t *a, const uint8_t *b, int n)
+                               { return pairSpanNeon(a, b, n, lut); });
+#endif
+    default: return pairOffsetScoreScalar(cells, rows, cols, di, dj, lut);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Swap delta kernel: out[k] = change of the gather score when the cells
+// first[k] and second[k] swap their types, 0 for cells of the same type.
+// numTypes is the number of rows of the table.
+// ---------------------------------------------------------------------------
+
+// Hint that an address will be read soon
+inline void prefetchRead(const void *address)
+{
+#if defined(SIMD_X86)
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+inline void swapDeltasScalar(const uint8_t *cells, const double *table, int numCells, const int *first, const int *second, int count, double *out)
+{
+    for (int k = 0; k < count; ++k)
+    {
+        const size_t a = first[k], b = second[k];
+        const size_t ta = cells[a], tb = cells[b];
+        out[k] = ta == tb ? 0.0 : table[tb * numCells + a] + table[ta * numCells + b] - table[ta * numCells + a] - table[tb * numCells + b];
+    }
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET_AVX2 inline void swapDeltasAvx2(const uint8_t *cells, const double *table, int numCells, const int *first, const int *second, int count, double *out)
+{
+    const __m128i stride = _mm_set1_epi32(numCells);
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    auto gather = [&](__m128i idx) SIMD_TARGET_AVX2 { return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, idx, all, 8); };
+
+    int k = 0;
+    for (; k + 4 <= count; k += 4)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + k));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second + k));
+        const __m128i ta = _mm_mullo_epi32(_mm_setr_epi32(cells[first[k]], cells[first[k + 1]], cells[first[k + 2]], cells[first[k + 3]]), stride);
+        const __m128i tb = _mm_mullo_epi32(_mm_setr_epi32(cells[second[k]], cells[second[k + 1]], cells[second[k + 2]], cells[second[k + 3]]), stride);
+
+        const __m256d swappedA = gather(_mm_add_epi32(tb, a));
+        const __m256d swappedB = gather(_mm_add_epi32(ta, b));
+        const __m256d currentA = gather(_mm_add_epi32(ta, a));
+        const __m256d currentB = gather(_mm_add_epi32(tb, b));
+        const __m256d delta = _mm256_sub_pd(_mm256_sub_pd(_mm256_add_pd(swappedA, swappedB), currentA), currentB);
+
+        const __m256d same = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(ta, tb)));
+        _mm256_storeu_pd(out + k, _mm256_andnot_pd(same, delta));
+    }
+    swapDeltasScalar(cells, table, numCells, first + k, second + k, count - k, out + k);
+}
+#endif
+
+// Dispatching entry point of the swap delta kernel
+inline void swapDeltas(const uint8_t *cells, const double *table, int numTypes, int numCells, const int *first, const int *second, int count, double *out)
+{
+    if (!gatherIndicesFit(numTypes, numCells))
+    {
+        swapDeltasScalar(cells, table, numCells, first, second, count, out);
+        return;
+    }
+
+    switch (detectSimdLevel())
+    {
+#if defined(SIMD_X86)
+    case SIMD_AVX512_LEVEL:
+    case SIMD_AVX2_LEVEL: swapDeltasAvx2(cells, table, numCells, first, second, count, out); return;
+#endif
+    default: swapDeltasScalar(cells, table, numCells, first, second, count, out);
+    }
+}
@@ -7,37 +7,38 @@
 #include <ctime>
 #include <cmath>
 #include <algorithm>
-#include <map>
 #include <chrono>
+#include <thread>
+#include <type_traits>
+
+#include "Annealer.h"
+#include "Grid.h"
+#include "Metropolis.h"
+#include "Random.h"
+#include "Schedules.h"
+#include "SimdKernels.h"
 
 using namespace std;
 using namespace std::chrono;
 
 enum CellType { EMPTY, RESIDENTIAL, COMMERCIAL, OFFICE };
 
-const int ROWS = 20;
-const int COLS = 20;
-
-// Score matrix for neighbor interactions
-map<pair<CellType, CellType>, int> scoreMatrix = {
-    {{RESIDENTIAL, RESIDENTIAL},  5},
-    {{RESIDENTIAL, COMMERCIAL},   3},
-    {{RESIDENTIAL, OFFICE},       1},
-    {{COMMERCIAL, COMMERCIAL},    4},
-    {{COMMERCIAL, OFFICE},        2},
-    {{OFFICE, OFFICE},            6},
-    // Symmetric scores
-    {{COMMERCIAL, RESIDENTIAL},   3},
-    {{OFFICE, RESIDENTIAL},       1},
-    {{OFFICE, COMMERCIAL},        2}
-};
+// Score of a neighbour interaction, indexed by the two cell types. EMPTY
+// cells score nothing; the table is symmetric.
+constexpr int NUM_CELL_TYPES = 4;
+constexpr int8_t pairTable[NUM_CELL_TYPES][NUM_CELL_TYPES] = {
+    //           EMPTY  RESIDENTIAL  COMMERCIAL  OFFICE
+    /* EMPTY */       {0, 0, 0, 0},
+    /* RESIDENTIAL */ {0, 5, 3, 1},
+    /* COMMERCIAL */  {0, 3, 4, 2},
+    /* OFFICE */      {0, 1, 2, 6}};
 
 // Function to print the grid
-void printGrid(const vector<vector<CellType>>& grid) {
-    for (const auto& row : grid) {
-        for (const auto& cell : row) {
+void printGrid(const Grid<CellType>& grid) {
+    for (int i = 0; i < grid.rows(); ++i) {
+        for (int j = 0; j < grid.cols(); ++j) {
             char c;
-            switch (cell) {
+            switch (grid(i, j)) {
                 case RESIDENTIAL: c = 'R'; break;
                 case COMMERCIAL:  c = 'C'; break;
                 case OFFICE:      c = 'O'; break;
@@ -49,88 +50,420 @@ void printGrid(const vector<vector<CellType>>& grid) {
     }
 }
 
-// Function to calculate total score
-int calculateScore(const vector<vector<CellType>>& grid) {
-    int totalScore = 0;
+// Score of a single edge between two cells (EMPTY cells score nothing)
+inline int pairScore(CellType a, CellType b) {
+    return pairTable[a][b];
+}
+
+// Total score kernel: visits every horizontal edge (i, j)-(i, j + 1) and every
+// vertical edge (i, j)-(i + 1, j) exactly once, so the loops need no bounds
+// checks. FIXED_ROWS/FIXED_COLS > 0 fix the dimensions at compile time.
+template <int FIXED_ROWS, int FIXED_COLS>
+struct EdgeScoreKernel {
+    template <typename Cell>
+    static int run(const Cell* cells, int runtimeRows, int runtimeCols) {
+        const int rows = FIXED_ROWS > 0 ? FIXED_ROWS : runtimeRows;
+        const int cols = FIXED_COLS > 0 ? FIXED_COLS : runtimeCols;
+        int totalScore = 0;
+
+        for (int i = 0; i < rows; ++i) {
+            const Cell* row = cells + i * cols;
+            for (int j = 0; j + 1 < cols; ++j) {
+                totalScore += pairScore(static_cast<CellType>(row[j]), static_cast<CellType>(row[j + 1]));
+            }
+            if (i + 1 < rows) {
+                const Cell* below = row + cols;
+                for (int j = 0; j < cols; ++j) {
+                    totalScore += pairScore(static_cast<CellType>(row[j]), static_cast<CellType>(below[j]));
+                }
+            }
+        }
+        return totalScore;
+    }
+};
+
+// Pair table flattened to 16 entries indexed by a * 4 + b, for the
+// vectorised pair kernels in SimdKernels.h
+void buildPairTable(int8_t lut[16]) {
+    for (int a = 0; a < NUM_CELL_TYPES; ++a) {
+        for (int b = 0; b < NUM_CELL_TYPES; ++b) {
+            lut[a * 4 + b] = pairTable[a][b];
+        }
+    }
+}
+
+// Function to calculate total score, using a compile-time specialised kernel
+// for the small fixed grid sizes and the vectorised pair kernel otherwise
+long long calculateScore(const Grid<CellType>& grid) {
+    if (isDispatchedGridSize(grid.rows(), grid.cols())) {
+        return dispatchGridSize<EdgeScoreKernel>(grid.rows(), grid.cols(), grid.data(), grid.rows(), grid.cols());
+    }
+    int8_t lut[16];
+    buildPairTable(lut);
+    return pairTableScore(grid.data(), grid.rows(), grid.cols(), lut);
+}
+
+// Function to calculate the total score of a fixed-size layout such as
+// CellType site[20][20], always using the kernel for its std::extent dimensions
+template <typename Array>
+int calculateScore(const Array& cells) {
+    constexpr int rows = static_cast<int>(extent<Array, 0>::value);
+    constexpr int cols = static_cast<int>(extent<Array, 1>::value);
+    return EdgeScoreKernel<rows, cols>::run(&cells[0][0], rows, cols);
+}
+
+// Sum of the edge scores touching (x1, y1) or (x2, y2), optionally as if the
+// two cells had been swapped. An edge between the two cells is counted once.
+int localScore(const Grid<CellType>& grid, int x1, int y1, int x2, int y2, bool swapped) {
     int dx[] = { -1, 0, 1, 0 };
     int dy[] = { 0, -1, 0, 1 };
 
-    for (int i = 0; i < ROWS; ++i) {
-        for (int j = 0; j < COLS; ++j) {
-            CellType current = grid[i][j];
-            if (current == EMPTY) continue;
-
-            for (int dir = 0; dir < 4; ++dir) {
-                int ni = i + dx[dir];
-                int nj = j + dy[dir];
-                if (ni >= 0 && ni < ROWS && nj >= 0 && nj < COLS) {
-                    CellType neighbor = grid[ni][nj];
-                    if (neighbor != EMPTY) {
-                        totalScore += scoreMatrix[{current, neighbor}];
-                    }
-                }
+    auto cellAt = [&](int i, int j) {
+        if (swapped) {
+            if (i == x1 && j == y1) return grid(x2, y2);
+            if (i == x2 && j == y2) return grid(x1, y1);
+        }
+        return grid(i, j);
+    };
+
+    int score = 0;
+    for (int dir = 0; dir < 4; ++dir) {
+        int ni = x1 + dx[dir];
+        int nj = y1 + dy[dir];
+        if (ni >= 0 && ni < grid.rows() && nj >= 0 && nj < grid.cols()) {
+            score += pairScore(cellAt(x1, y1), cellAt(ni, nj));
+        }
+    }
+    for (int dir = 0; dir < 4; ++dir) {
+        int ni = x2 + dx[dir];
+        int nj = y2 + dy[dir];
+        if (ni == x1 && nj == y1) continue; // Already counted from the first cell
+        if (ni >= 0 && ni < grid.rows() && nj >= 0 && nj < grid.cols()) {
+            score += pairScore(cellAt(x2, y2), cellAt(ni, nj));
+        }
+    }
+    return score;
+}
+
+// Change in total score caused by swapping two cells. Only the (at most 8)
+// edges touching the swapped cells change, so the cost is independent of
+// the grid size.
+int swapDelta(const Grid<CellType>& grid, int x1, int y1, int x2, int y2) {
+    if (grid(x1, y1) == grid(x2, y2)) return 0;
+    return localScore(grid, x1, y1, x2, y2, true) - localScore(grid, x1, y1, x2, y2, false);
+}
+
+// Neighbour of a stencil: the offset to it and the weight of the edge
+struct StencilOffset {
+    int di, dj;
+    int weight;
+};
+
+// Neighbourhood the adjacency score is taken over. Every edge is stored
+// once, as the offset from its first cell in row-major order (di > 0, or
+// di == 0 and dj > 0); the score is the weighted sum of pairScore over the
+// edges of all cells.
+struct Stencil {
+    vector<StencilOffset> offsets;
+    int reach = 0; // Largest |di| or |dj| of an offset
+
+    // The 4 edge-adjacent neighbours, the model's default
+    static Stencil fourNeighbour() {
+        return fromOffsets({{0, 1, 1}, {1, 0, 1}});
+    }
+
+    // The 8 neighbours including the diagonals
+    static Stencil eightNeighbour() {
+        return fromOffsets({{0, 1, 1}, {1, -1, 1}, {1, 0, 1}, {1, 1, 1}});
+    }
+
+    // Every cell within Euclidean distance r, weighted r + 1 - ceil(distance),
+    // so the nearest neighbours weigh r and the farthest 1
+    static Stencil radius(int r) {
+        vector<StencilOffset> offsets;
+        for (int di = 0; di <= r; ++di) {
+            for (int dj = -r; dj <= r; ++dj) {
+                if ((di == 0 && dj <= 0) || di * di + dj * dj > r * r) continue;
+                const double distance = sqrt(double(di * di + dj * dj));
+                offsets.push_back({di, dj, r + 1 - static_cast<int>(ceil(distance - 1e-9))});
             }
         }
+        return fromOffsets(offsets);
     }
-    // Each pair counted twice
-    return totalScore / 2;
+
+    static Stencil fromOffsets(const vector<StencilOffset>& offsets) {
+        Stencil stencil;
+        stencil.offsets = offsets;
+        for (const StencilOffset& o : offsets) {
+            stencil.reach = max(stencil.reach, max(abs(o.di), abs(o.dj)));
+        }
+        return stencil;
+    }
+
+    // Whether this is the 4-neighbour stencil with unit weights
+    bool isFourNeighbour() const {
+        if (offsets.size() != 2) return false;
+        for (const StencilOffset& o : offsets) {
+            if (o.weight != 1 || o.di * o.di + o.dj * o.dj != 1) return false;
+        }
+        return offsets[0].di != offsets[1].di;
+    }
+
+    // Whether a neighbour lies off the row and column of a cell
+    bool hasDiagonals() const {
+        for (const StencilOffset& o : offsets) {
+            if (o.di != 0 && o.dj != 0) return true;
+        }
+        return false;
+    }
+};
+
+// Function to calculate total score over a stencil: one sweep of the rows
+// with the vectorised offset pair kernel per stencil offset. A weighted
+// stencil on a large grid outgrows int, so scores are 64-bit.
+long long calculateScore(const Grid<CellType>& grid, const Stencil& stencil) {
+    int8_t lut[16];
+    buildPairTable(lut);
+    long long total = 0;
+    for (const StencilOffset& o : stencil.offsets) {
+        total += o.weight * pairOffsetScore(grid.data(), grid.rows(), grid.cols(), o.di, o.dj, lut);
+    }
+    return total;
+}
+
+// Change in total score caused by swapping two cells over a stencil. Only
+// the edges from the swapped cells to their neighbours change; an edge
+// between the two cells keeps its score, as the pair table is symmetric.
+int swapDelta(const Grid<CellType>& grid, const Stencil& stencil, int x1, int y1, int x2, int y2) {
+    const CellType first = grid(x1, y1);
+    const CellType second = grid(x2, y2);
+    if (first == second) return 0;
+
+    int delta = 0;
+    auto edgesOf = [&](int x, int y, CellType from, CellType to, int skipX, int skipY) {
+        for (const StencilOffset& o : stencil.offsets) {
+            // The edge in both directions: to (x + di, y + dj) and from (x - di, y - dj)
+            for (int sign = -1; sign <= 1; sign += 2) {
+                const int ni = x + sign * o.di;
+                const int nj = y + sign * o.dj;
+                if (ni < 0 || ni >= grid.rows() || nj < 0 || nj >= grid.cols() || (ni == skipX && nj == skipY)) continue;
+                const CellType neighbour = grid(ni, nj);
+                delta += o.weight * (pairTable[to][neighbour] - pairTable[from][neighbour]);
+            }
+        }
+    };
+    edgesOf(x1, y1, first, second, x2, y2);
+    edgesOf(x2, y2, second, first, x1, y1);
+    return delta;
+}
+
+// Swap of two cells by coordinates, the move of the adjacency model
+struct GridSwap {
+    int x1, y1, x2, y2;
+
+    void apply(Grid<CellType>& grid) const { grid.swapCells(grid.index(x1, y1), grid.index(x2, y2)); }
+    void undo(Grid<CellType>& grid) const { apply(grid); }
+};
+
+// Energy of the adjacency model for Annealer (see Annealer.h): swaps of two
+// random cells of a window of the grid, the whole grid by default, scored
+// over a stencil. The 4-neighbour stencil (or null) uses the specialised
+// kernels above.
+struct AdjacencyEnergy {
+    int top = 0, left = 0, rows = 0, cols = 0;
+    const Stencil* stencil = nullptr; // Null for the 4-neighbour kernels
+
+    explicit AdjacencyEnergy(const Grid<CellType>& grid, const Stencil* stencil = nullptr)
+        : rows(grid.rows()), cols(grid.cols()), stencil(general(stencil)) {}
+    AdjacencyEnergy(int top, int left, int rows, int cols, const Stencil* stencil = nullptr)
+        : top(top), left(left), rows(rows), cols(cols), stencil(general(stencil)) {}
+
+    static const Stencil* general(const Stencil* stencil) {
+        return stencil && !stencil->isFourNeighbour() ? stencil : nullptr;
+    }
+
+    GridSwap propose(const Grid<CellType>&, Rng& rng) const {
+        GridSwap move;
+        move.x1 = top + rng.uniform(rows);
+        move.y1 = left + rng.uniform(cols);
+        move.x2 = top + rng.uniform(rows);
+        move.y2 = left + rng.uniform(cols);
+        return move;
+    }
+
+    double delta(const Grid<CellType>& grid, const GridSwap& move) const {
+        return stencil ? swapDelta(grid, *stencil, move.x1, move.y1, move.x2, move.y2) : swapDelta(grid, move.x1, move.y1, move.x2, move.y2);
+    }
+    double score(const Grid<CellType>& grid) const { return stencil ? calculateScore(grid, *stencil) : calculateScore(grid); }
+};
+
+// Simulated Annealing Optimization, over the 4-neighbour stencil unless
+// another one is given
+void optimizeGrid(Grid<CellType>& grid, Rng& rng, const Stencil* stencil = nullptr) {
+    const AdjacencyEnergy energy(grid, stencil);
+    GeometricSchedule schedule(1000.0, 1.0, 0.003);
+    Grid<CellType> bestGrid = grid;
+    Metropolis metropolis; // Acceptance test against batched log(u), see Metropolis.h
+
+    Annealer<Grid<CellType>, GridSwap, AdjacencyEnergy, GeometricSchedule> annealer(grid, &bestGrid, energy, schedule, rng, metropolis);
+    annealer.currentScore = annealer.bestScore = energy.score(grid);
+    annealer.run();
+
+    grid = bestGrid;
 }
 
-// Simulated Annealing Optimization
-void optimizeGrid(vector<vector<CellType>>& grid) {
-    double temperature = 1000.0;
-    double coolingRate = 0.003;
-    int currentScore = calculateScore(grid);
-    vector<vector<CellType>> bestGrid = grid;
-    int bestScore = currentScore;
-
-    while (temperature > 1) {
-        // Generate neighboring solution by swapping two random cells
-        vector<vector<CellType>> newGrid = grid;
-        int x1 = rand() % ROWS;
-        int y1 = rand() % COLS;
-        int x2 = rand() % ROWS;
-        int y2 = rand() % COLS;
-
-        swap(newGrid[x1][y1], newGrid[x2][y2]);
-
-        int newScore = calculateScore(newGrid);
-        int deltaScore = newScore - currentScore;
-
-        if (deltaScore > 0 || exp(deltaScore / temperature) > ((double)rand() / RAND_MAX)) {
-            grid = newGrid;
-            currentScore = newScore;
-
-            if (currentScore > bestScore) {
-                bestGrid = grid;
-                bestScore = currentScore;
+// Settings for optimizeGridTiled
+struct TiledOptions {
+    int tileSize = 64;          // Side of the square tiles
+    int threads = 0;            // Worker threads, 0 = one per hardware thread
+    double temperature = 10.0;  // Temperature of the first round
+    double cooldown = 0.1;      // Stop once the temperature falls below this
+    double coolingRate = 0.05;  // Temperature decrease per round
+    double movesPerCell = 1.0;  // Tile-local proposals per cell and round
+    double globalMoves = 0.05;  // Cross-tile proposals per cell and round
+    const Stencil* stencil = nullptr; // Neighbourhood of the score, null = 4-neighbour
+};
+
+// Parallel simulated annealing for large grids by domain decomposition. The
+// grid is cut into square tiles coloured like a checkerboard. A swap only
+// changes the edges around the two swapped cells, so a swap inside a tile
+// writes nothing outside it and reads only the edge-adjacent tiles, which
+// have the other colour. Each round therefore anneals all tiles of one
+// colour concurrently with tile-local swaps, then all tiles of the other
+// colour; cells on a tile boundary are swapped in their own tile's phase
+// while the tiles next to them are idle, so every delta is exact. Stencils
+// with diagonal neighbours also read the corner-adjacent tiles and use four
+// colours in 2x2 blocks instead, and tiles are made at least as wide as the
+// stencil's reach so no swap reads past the neighbouring tile. A serial
+// global phase then proposes swaps between random cells anywhere on the
+// grid, which lets the composition of the tiles (the agent quotas of each
+// region) change.
+//
+// Every tile and the global phase have their own Rng stream, so a run is
+// reproducible from its seed regardless of the number of threads. The
+// temperature is constant within a round and cools geometrically between
+// rounds; the best grid is kept at round boundaries.
+void optimizeGridTiled(Grid<CellType>& grid, uint64_t seed, const TiledOptions& options = TiledOptions()) {
+    const int reach = options.stencil ? options.stencil->reach : 1;
+    const int tileSize = max(max(options.tileSize, 2), reach);
+    const int numColours = options.stencil && options.stencil->hasDiagonals() ? 4 : 2;
+    const int tileRows = (grid.rows() + tileSize - 1) / tileSize;
+    const int tileCols = (grid.cols() + tileSize - 1) / tileSize;
+
+    struct Tile {
+        int top, left, rows, cols;
+        Rng rng;
+        Metropolis metropolis;
+        long long delta; // Score change of the current phase
+    };
+    vector<Tile> tiles;
+    vector<vector<int>> tilesOfColour(numColours);
+    for (int ti = 0; ti < tileRows; ++ti) {
+        for (int tj = 0; tj < tileCols; ++tj) {
+            const int top = ti * tileSize;
+            const int left = tj * tileSize;
+            const int colour = numColours == 4 ? (ti % 2) * 2 + tj % 2 : (ti + tj) % 2;
+            tilesOfColour[colour].push_back(static_cast<int>(tiles.size()));
+            tiles.push_back({top, left, min(tileSize, grid.rows() - top), min(tileSize, grid.cols() - left),
+                             Rng::stream(seed, tiles.size() + 1), Metropolis(), 0});
+        }
+    }
+
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(thread::hardware_concurrency());
+    threads = max(threads, 1);
+
+    Rng globalRng = Rng::stream(seed, 0);
+    Metropolis globalMetropolis;
+    long long currentScore = options.stencil ? calculateScore(grid, *options.stencil) : calculateScore(grid);
+    Grid<CellType> bestGrid = grid;
+    long long bestScore = currentScore;
+
+    // Constant-temperature run of `moves` proposals in one window, without
+    // best tracking. Returns the score change.
+    auto annealWindow = [&](const AdjacencyEnergy& energy, long long moves, double temperature, Rng& rng, Metropolis& metropolis) {
+        ConstantSchedule schedule(temperature, moves);
+        Annealer<Grid<CellType>, GridSwap, AdjacencyEnergy, ConstantSchedule> annealer(grid, nullptr, energy, schedule, rng, metropolis);
+        annealer.run();
+        return static_cast<long long>(annealer.currentScore);
+    };
+
+    auto annealTile = [&](Tile& tile, double temperature) {
+        const long long moves = static_cast<long long>(options.movesPerCell * tile.rows * tile.cols);
+        tile.delta = annealWindow(AdjacencyEnergy(tile.top, tile.left, tile.rows, tile.cols, options.stencil), moves, temperature, tile.rng, tile.metropolis);
+    };
+
+    for (double temperature = options.temperature; temperature > options.cooldown; temperature *= 1 - options.coolingRate) {
+        // Checkerboard phases: tiles of one colour never read each other's cells
+        for (const vector<int>& colour : tilesOfColour) {
+            const int numWorkers = min(threads, static_cast<int>(colour.size()));
+            auto worker = [&](int w) {
+                for (size_t t = w; t < colour.size(); t += numWorkers) {
+                    annealTile(tiles[colour[t]], temperature);
+                }
+            };
+            vector<thread> workers;
+            for (int w = 1; w < numWorkers; ++w) {
+                workers.emplace_back(worker, w);
+            }
+            worker(0);
+            for (thread& t : workers) {
+                t.join();
+            }
+            for (int t : colour) {
+                currentScore += tiles[t].delta;
             }
         }
 
-        temperature *= 1 - coolingRate;
+        // Global phase: cross-tile swaps on the whole grid
+        const long long globalMoves = static_cast<long long>(options.globalMoves * grid.size());
+        currentScore += annealWindow(AdjacencyEnergy(grid, options.stencil), globalMoves, temperature, globalRng, globalMetropolis);
+
+        if (currentScore > bestScore) {
+            bestGrid = grid;
+            bestScore = currentScore;
+        }
     }
 
     grid = bestGrid;
 }
 
-int main() {
-    srand(static_cast<unsigned int>(time(0)));
+// Define ADJACENCY_NO_MAIN before including this file to use the optimiser
+// as a library. The whole file is only compiled with _MAIN_ defined (see the
+// top of the file), so the includer defines both:
+//
+//   #define _MAIN_
+//   #define ADJACENCY_NO_MAIN
+//   #include "SimulatedAnnealing.cpp"
+#ifndef ADJACENCY_NO_MAIN
+int main(int argc, char* argv[]) {
+    // Pass a seed as the first argument to reproduce a run
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : static_cast<uint64_t>(time(0));
+    Rng rng(seed);
+    cout << "Seed: " << seed << endl;
 
     // Initialize grid with EMPTY cells
-    vector<vector<CellType>> grid(ROWS, vector<CellType>(COLS, EMPTY));
+    // Grid dimensions are optional second and third arguments
+    int rows = argc > 2 ? atoi(argv[2]) : 20;
+    int cols = argc > 3 ? atoi(argv[3]) : rows;
+    if (rows < 2 || cols < 2) {
+        // The preset cells below need at least a 2x2 grid
+        cerr << "Grid must be at least 2x2" << endl;
+        return 1;
+    }
+    Grid<CellType> grid(rows, cols, EMPTY);
 
     // Preset types (can be loaded from input if needed)
     // For simplicity, we'll randomly place some preset types
-    grid[0][0] = RESIDENTIAL;
-    grid[0][1] = COMMERCIAL;
-    grid[1][0] = OFFICE;
+    grid.set(0, 0, RESIDENTIAL);
+    grid.set(0, 1, COMMERCIAL);
+    grid.set(1, 0, OFFICE);
 
     // Percentages for each type
     double residentialPerc = 0.4;
     double commercialPerc = 0.35;
     double officePerc = 0.25;
 
-    int totalCells = ROWS * COLS - 3; // Adjusting for preset cells
+    int totalCells = grid.size() - 3; // Adjusting for preset cells
     int residentialCells = residentialPerc * totalCells;
     int commercialCells = commercialPerc * totalCells;
     int officeCells = totalCells - residentialCells - commercialCells;
@@ -141,35 +474,44 @@ int main() {
     for (int i = 0; i < officeCells; ++i)      cells.push_back(OFFICE);
 
     // Shuffle and assign to grid
-    random_shuffle(cells.begin(), cells.end());
+    shuffle(cells.begin(), cells.end(), rng);
     int index = 0;
-    for (int i = 0; i < ROWS && index < cells.size(); ++i) {
-        for (int j = 0; j < COLS && index < cells.size(); ++j) {
-            if (grid[i][j] == EMPTY) {
-                grid[i][j] = cells[index++];
-            }
+    for (int idx = 0; idx < grid.size() && index < cells.size(); ++idx) {
+        if (grid[idx] == EMPTY) {
+            grid.set(idx, cells[index++]);
         }
     }
 
     cout << "Initial Grid:" << endl;
     printGrid(grid);
-    cout << "Initial Score: " << calculateScore(grid) << endl;
+    // Neighbourhood of the score: the 4 edge-adjacent cells
+    const Stencil stencil = Stencil::fourNeighbour();
+    // const Stencil stencil = Stencil::eightNeighbour();
+    // const Stencil stencil = Stencil::radius(3);
+
+    cout << "Initial Score: " << calculateScore(grid, stencil) << endl;
 
     // Measure computation time
     auto start = high_resolution_clock::now();
 
-    optimizeGrid(grid);
+    optimizeGrid(grid, rng, &stencil);
+
+    // Alternative for very large grids: tiled annealing on every core
+    // TiledOptions options;
+    // options.stencil = &stencil;
+    // optimizeGridTiled(grid, seed, options);
 
     auto end = high_resolution_clock::now();
     auto duration = duration_cast<milliseconds>(end - start);
 
     cout << "\nOptimized Grid:" << endl;
     printGrid(grid);
-    cout << "Optimized Score: " << calculateScore(grid) << endl;
+    cout << "Optimized Score: " << calculateScore(grid, stencil) << endl;
 
     cout << "Computation Time: " << duration.count() << " milliseconds" << endl;
 
     return 0;
 }
+#endif // ADJACENCY_NO_MAIN
 
 #endif // _MAIN_
\ No newline at end of file
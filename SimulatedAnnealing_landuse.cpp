@@ -14,11 +14,12 @@
  *
  * Complexity Analysis:
  * 1. Grid Initialization: O(n*m), where n and m are grid dimensions.
- * 2. Distance Map Computation (BFS): O(n*m*k), where k is the number
- *    of fixed land use cells.
- * 3. Simulated Annealing Optimization: O(t * (n*m)), where t is the
- *    number of iterations.
- * Overall Complexity: O(n*m*(k + t)), typically scalable for small grids.
+ * 2. Distance Map Computation (multi-label BFS): O(n*m*k), where k is
+ *    the number of land use types, in a single sweep over the grid.
+ * 3. Utility Table: O(n*m*k*a), where a is the number of agent types.
+ * 4. Simulated Annealing Optimization: O(t), where t is the number of
+ *    iterations, since each swap is scored in O(1) via swapDelta.
+ * Overall Complexity: O(n*m*k*a + t), scalable to large grids.
  *
  * Author: Taizhong Chen | taizhong.chen@zaha-hadid.com
  * Date: 28.11.2024
@@ -27,8 +28,6 @@
 #define _MAIN_
 #ifdef _MAIN_
 
-#define LOG_PERF 1 && std::cout
-
 #include <iostream>
 #include <vector>
 #include <cstdlib>
@@ -39,7 +38,26 @@
 #include <chrono>
 #include <limits>
 #include <iomanip>
+#include <thread>
+#include <atomic>
 #include <queue>
+#include <functional>
+#include <fstream>
+#include <string>
+#include <complex>
+#include <cstdio>
+
+#include "Grid.h"
+#include "PackedGrid.h"
+#include "Random.h"
+#include "SimdKernels.h"
+#include "Metrics.h"
+#include "Metropolis.h"
+#include "Annealer.h"
+#include "GridFile.h"
+#include "Checkpoint.h"
+#include "Schedules.h"
+#include "WorkStealing.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -54,34 +72,64 @@ enum CellType
     TRANSPORT, // T
     PUBLIC,    // P
     LANDSCAPE, // L
-    ROAD       // R
+    ROAD,      // R
+    NUM_CELL_TYPES
+};
+
+static_assert(NUM_CELL_TYPES <= 16, "PackedGrid stores cell types in 4 bits");
+
+// Compile-time scenario: the land use types, agent types and preference
+// table are constants, so kernels templated on a scenario get fixed trip
+// counts and have the preferences folded in. Other scenarios follow the same
+// layout: LAND_USE_COUNT, AGENT_COUNT, landUseTypes, agentTypes, preferences.
+struct StandardScenario
+{
+    static constexpr int LAND_USE_COUNT = 4;
+    static constexpr int AGENT_COUNT = 4;
+    static constexpr CellType landUseTypes[LAND_USE_COUNT] = {TRANSPORT, PUBLIC, LANDSCAPE, ROAD};
+    static constexpr CellType agentTypes[AGENT_COUNT] = {RESIDENTIAL, OFFICE, COM_SHOP, COM_CAFE};
+
+    // Preference of each agent type towards each land use type
+    static constexpr float preferences[AGENT_COUNT][LAND_USE_COUNT] = {
+        {1, 2, 3, -5},
+        {4, 1, 0, 2},
+        {5, 3, 0, 3},
+        {2, 4, 1, -1}};
 };
 
-const int ROWS = 12;
-const int COLS = 12;
+// Function to expand a scenario's preference table into the runtime map form
+template <class Scenario>
+map<CellType, vector<float>> scenarioPreferences()
+{
+    map<CellType, vector<float>> preferences;
+    for (int a = 0; a < Scenario::AGENT_COUNT; ++a)
+    {
+        preferences[Scenario::agentTypes[a]].assign(begin(Scenario::preferences[a]), end(Scenario::preferences[a]));
+    }
+    return preferences;
+}
+
+// Runtime scenario, used by the non-templated functions. It starts out as the
+// standard scenario and can be reconfigured for ad-hoc runs.
 
 // Land Use Types (fixed on the grid)
-const vector<CellType> landUseTypes = {TRANSPORT, PUBLIC, LANDSCAPE, ROAD};
+vector<CellType> landUseTypes(begin(StandardScenario::landUseTypes), end(StandardScenario::landUseTypes));
 
 // Agent Types
-const vector<CellType> agentTypes = {RESIDENTIAL, OFFICE, COM_SHOP, COM_CAFE};
+vector<CellType> agentTypes(begin(StandardScenario::agentTypes), end(StandardScenario::agentTypes));
 
 // Preference arrays for each agent type towards each land use type
-map<CellType, vector<float>> agentPreferences = {
-    {RESIDENTIAL, {1, 2, 3, -5}},
-    {OFFICE, {4, 1, 0, 2}},
-    {COM_SHOP, {5, 3, 0, 3}},
-    {COM_CAFE, {2, 4, 1, -1}}};
+map<CellType, vector<float>> agentPreferences = scenarioPreferences<StandardScenario>();
 
 // Function to print the grid
-void printGrid(const vector<vector<CellType>> &grid)
+void printGrid(const Grid<CellType> &grid)
 {
-    for (const auto &row : grid)
+    for (int i = 0; i < grid.rows(); ++i)
     {
-        for (const auto &cell : row)
+        for (int j = 0; j < grid.cols(); ++j)
         {
             char c;
-            switch (cell)
+            switch (grid(i, j))
             {
             case RESIDENTIAL:
                 c = 'R';
@@ -111,210 +159,2288 @@ void printGrid(const vector<vector<CellType>> &grid)
                 c = '.';
                 break;
             }
-            cout << c << ' ';
+            cout << c << ' ';
+        }
+        cout << endl;
+    }
+}
+
+// Names of the cell types in site file dictionaries
+const char *cellTypeNames[NUM_CELL_TYPES] = {
+    "EMPTY", "RESIDENTIAL", "OFFICE", "COM_SHOP", "COM_CAFE", "TRANSPORT", "PUBLIC", "LANDSCAPE", "ROAD"};
+
+// Function to describe the runtime scenario, for writing or importing site files
+SiteDescription siteDescription()
+{
+    SiteDescription description;
+    description.typeNames.assign(begin(cellTypeNames), end(cellTypeNames));
+    description.landUseTypes.assign(landUseTypes.begin(), landUseTypes.end());
+    for (CellType agentType : agentTypes)
+    {
+        description.agentTypes.push_back(static_cast<uint8_t>(agentType));
+        const vector<float> &preferences = agentPreferences[agentType];
+        description.preferences.insert(description.preferences.end(), preferences.begin(), preferences.end());
+    }
+    return description;
+}
+
+// Function to load a mapped site file: points grid at the mapped cells and
+// makes the file's agent types, land use types and preferences the runtime
+// scenario. The type codes and cells are checked against the dictionary;
+// cells are only rewritten (in the private mapping) if the file's
+// dictionary numbers the types differently from CellType.
+bool loadSite(const SiteFile &site, Grid<CellType> &grid, string &error)
+{
+    const SiteDescription &description = site.description();
+
+    // Cell type of every file code, matched by name
+    vector<uint8_t> typeOf(256, 0);
+    bool identity = true;
+    for (size_t code = 0; code < description.typeNames.size(); ++code)
+    {
+        auto it = find(begin(cellTypeNames), end(cellTypeNames), description.typeNames[code]);
+        if (it == end(cellTypeNames))
+        {
+            error = "unknown cell type '" + description.typeNames[code] + "' in site dictionary";
+            return false;
+        }
+        typeOf[code] = static_cast<uint8_t>(it - begin(cellTypeNames));
+        identity = identity && typeOf[code] == code;
+    }
+
+    if (description.preferences.size() != description.agentTypes.size() * description.landUseTypes.size())
+    {
+        error = "site preference table does not match its agent and land use types";
+        return false;
+    }
+
+    // Agents must be placeable types, and land uses must be types no agent has
+    for (uint8_t code : description.landUseTypes)
+    {
+        if (typeOf[code] == EMPTY)
+        {
+            error = "site land use type '" + description.typeNames[code] + "' is EMPTY";
+            return false;
+        }
+    }
+    for (uint8_t code : description.agentTypes)
+    {
+        const bool isLandUse = find(description.landUseTypes.begin(), description.landUseTypes.end(), code) != description.landUseTypes.end();
+        if (typeOf[code] == EMPTY || isLandUse)
+        {
+            error = "site agent type '" + description.typeNames[code] + "' is EMPTY or a land use type";
+            return false;
+        }
+    }
+
+    // One pass over the cells: every value must be in the dictionary, and is
+    // renumbered to its CellType unless the numbering already matches
+    grid = site.grid<CellType>();
+    uint8_t *cells = grid.data();
+    const size_t typeCount = description.typeNames.size();
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (cells[idx] >= typeCount)
+        {
+            error = "site cell " + to_string(idx) + " has value " + to_string(cells[idx]) + " outside the site dictionary";
+            grid = Grid<CellType>();
+            return false;
+        }
+        if (!identity)
+            cells[idx] = typeOf[cells[idx]];
+    }
+
+    const size_t numLandUse = description.landUseTypes.size();
+    landUseTypes.clear();
+    for (uint8_t code : description.landUseTypes)
+    {
+        landUseTypes.push_back(static_cast<CellType>(typeOf[code]));
+    }
+    agentTypes.clear();
+    agentPreferences.clear();
+    for (size_t a = 0; a < description.agentTypes.size(); ++a)
+    {
+        CellType agentType = static_cast<CellType>(typeOf[description.agentTypes[a]]);
+        agentTypes.push_back(agentType);
+        agentPreferences[agentType].assign(description.preferences.begin() + a * numLandUse,
+                                           description.preferences.begin() + (a + 1) * numLandUse);
+    }
+    return true;
+}
+
+// Marker for cells that cannot reach any cell of a land use type
+const uint16_t UNREACHABLE_DISTANCE = 0xFFFF;
+
+// Distance fields of all land use types in a structure-of-arrays layout:
+// values[k * rows * cols + idx] is the distance from cell idx to the nearest
+// cell of landUseTypes[k] in steps of units[k], or UNREACHABLE_DISTANCE.
+// Distances are stored as uint16_t (2 bytes per cell and type) and saturate
+// at 0xFFFE. Grid distances use a unit of 1; the Euclidean and weighted
+// backends choose the finest unit that fits each field's range.
+struct DistanceMaps
+{
+    int rows = 0;
+    int cols = 0;
+    int types = 0;
+    vector<uint16_t> values;
+    vector<double> units;
+    vector<CellType> landUse; // Land use type of each field
+
+    // Field of a land use type, or -1 if it was not computed
+    int fieldIndex(CellType type) const
+    {
+        auto it = find(landUse.begin(), landUse.end(), type);
+        return it == landUse.end() ? -1 : static_cast<int>(it - landUse.begin());
+    }
+
+    const uint16_t *field(int k) const { return &values[static_cast<size_t>(k) * rows * cols]; }
+    uint16_t *field(int k) { return &values[static_cast<size_t>(k) * rows * cols]; }
+    uint16_t at(int k, int idx) const { return field(k)[idx]; }
+
+    // Distance in cells, only meaningful when at(k, idx) != UNREACHABLE_DISTANCE
+    double distance(int k, int idx) const { return at(k, idx) * units[k]; }
+
+    size_t memoryBytes() const { return values.capacity() * sizeof(uint16_t) + units.capacity() * sizeof(double); }
+};
+
+// Available distance backends
+enum DistanceMetric
+{
+    MANHATTAN, // 4-connected grid distance (multi-label BFS)
+    EUCLIDEAN, // Exact Euclidean distance transform
+    WEIGHTED   // 8-connected chamfer distance with per-cell traversal costs (Dijkstra)
+};
+
+// Default traversal cost of entering each cell type for the weighted backend:
+// roads are cheap, landscape is expensive. Infinite costs make cells impassable.
+vector<float> defaultTraversalCosts()
+{
+    vector<float> costs(NUM_CELL_TYPES, 1.0f);
+    costs[ROAD] = 0.5f;
+    costs[LANDSCAPE] = 3.0f;
+    return costs;
+}
+
+// Settings for computeDistanceMaps
+struct DistanceOptions
+{
+    DistanceMetric metric = MANHATTAN;
+    vector<float> traversalCosts = defaultTraversalCosts(); // Per CellType, WEIGHTED only
+    int threads = 0; // 0 = one per type on large grids, a single thread on small ones
+};
+
+// Function to compute the distance fields of land use types [firstType, lastType)
+// in one multi-label BFS sweep. Each cell carries a bitmask of the labels that
+// reached it, and the frontier entry of a cell carries the labels that arrived
+// at the current level, so every cell is expanded at most once per level for
+// all labels together. The frontier is a flat ring buffer of cell indices.
+// A sweep handles at most MAX_SWEEP_LABELS types, one bit each.
+// FIXED_ROWS/FIXED_COLS > 0 fix the grid dimensions at compile time.
+const int MAX_SWEEP_LABELS = 8;
+
+template <int FIXED_ROWS, int FIXED_COLS>
+struct DistanceSweepKernel
+{
+    static void run(const Grid<CellType> &grid, int firstType, int lastType, DistanceMaps &distanceMaps);
+};
+
+template <int FIXED_ROWS, int FIXED_COLS>
+void DistanceSweepKernel<FIXED_ROWS, FIXED_COLS>::run(const Grid<CellType> &grid, int firstType, int lastType, DistanceMaps &distanceMaps)
+{
+    const int rows = FIXED_ROWS > 0 ? FIXED_ROWS : grid.rows();
+    const int cols = FIXED_COLS > 0 ? FIXED_COLS : grid.cols();
+    const int numCells = rows * cols;
+
+    // Label bit of each cell type within this group
+    uint8_t labelBit[NUM_CELL_TYPES] = {};
+    for (int k = firstType; k < lastType; ++k)
+    {
+        labelBit[landUseTypes[k]] |= 1u << (k - firstType);
+    }
+
+    vector<uint8_t> reached(numCells, 0);
+    vector<uint8_t> currentMask(numCells, 0);
+    vector<uint8_t> nextMask(numCells, 0);
+
+    // A cell appears at most once per level, so two levels fit in 2 * numCells
+    const size_t capacity = 2 * static_cast<size_t>(max(numCells, 1));
+    vector<int> ring(capacity);
+    size_t head = 0, tail = 0;
+
+    // Seed the frontier with the land use cells themselves
+    for (int idx = 0; idx < numCells; ++idx)
+    {
+        uint8_t bits = labelBit[grid[idx]];
+        if (bits)
+        {
+            reached[idx] = currentMask[idx] = bits;
+            for (int k = firstType; k < lastType; ++k)
+                if (bits & (1u << (k - firstType)))
+                    distanceMaps.field(k)[idx] = 0;
+            ring[tail++ % capacity] = idx;
+        }
+    }
+
+    uint16_t level = 0;
+    while (head != tail)
+    {
+        const size_t levelEnd = tail;
+        const uint16_t distance = level < UNREACHABLE_DISTANCE - 1 ? level + 1 : UNREACHABLE_DISTANCE - 1;
+
+        while (head != levelEnd)
+        {
+            const int idx = ring[head++ % capacity];
+            const uint8_t mask = currentMask[idx];
+            currentMask[idx] = 0;
+
+            const int i = idx / cols;
+            const int j = idx - i * cols;
+            const int neighbours[4] = {i > 0 ? idx - cols : -1, j < cols - 1 ? idx + 1 : -1,
+                                       i < rows - 1 ? idx + cols : -1, j > 0 ? idx - 1 : -1};
+
+            for (int n : neighbours)
+            {
+                if (n < 0)
+                    continue;
+
+                uint8_t added = mask & ~reached[n];
+                if (!added)
+                    continue;
+
+                reached[n] |= added;
+                if (!nextMask[n])
+                    ring[tail++ % capacity] = n;
+                nextMask[n] |= added;
+
+                for (int k = firstType; k < lastType; ++k)
+                    if (added & (1u << (k - firstType)))
+                        distanceMaps.field(k)[n] = distance;
+            }
+        }
+
+        swap(currentMask, nextMask);
+        level++;
+    }
+}
+
+void sweepDistanceFields(const Grid<CellType> &grid, int firstType, int lastType, DistanceMaps &distanceMaps)
+{
+    dispatchGridSize<DistanceSweepKernel>(grid.rows(), grid.cols(), grid, firstType, lastType, distanceMaps);
+}
+
+// Function to store a field of real distances (infinity = unreachable) as
+// uint16_t in steps of the finest unit that fits the field's largest distance
+void quantiseDistanceField(const vector<float> &distances, int k, DistanceMaps &distanceMaps)
+{
+    float maxDistance = 0.0f;
+    for (float d : distances)
+        if (d != numeric_limits<float>::infinity())
+            maxDistance = max(maxDistance, d);
+
+    const double unit = maxDistance > 0.0f ? maxDistance / (UNREACHABLE_DISTANCE - 1) : 1.0;
+    distanceMaps.units[k] = unit;
+
+    uint16_t *field = distanceMaps.field(k);
+    for (size_t idx = 0; idx < distances.size(); ++idx)
+    {
+        field[idx] = distances[idx] == numeric_limits<float>::infinity()
+                         ? UNREACHABLE_DISTANCE
+                         : static_cast<uint16_t>(min(distances[idx] / unit + 0.5, UNREACHABLE_DISTANCE - 1.0));
+    }
+}
+
+// Function to compute the 1D squared distance transform of f into d in linear
+// time (Felzenszwalb & Huttenlocher): d[q] = min_p (q - p)^2 + f[p].
+// v and z are scratch buffers of n and n + 1 elements.
+void squaredDistanceTransform1D(const double *f, int n, double *d, int *v, double *z)
+{
+    const double INF = numeric_limits<double>::infinity();
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+
+    for (int q = 1; q < n; ++q)
+    {
+        if (f[q] == INF)
+            continue; // Cells without a source never form part of the lower envelope
+        if (f[v[k]] == INF)
+        {
+            v[k] = q; // Replace a sentinel-only envelope
+            continue;
+        }
+
+        double s = ((f[q] + static_cast<double>(q) * q) - (f[v[k]] + static_cast<double>(v[k]) * v[k])) / (2.0 * (q - v[k]));
+        while (s <= z[k])
+        {
+            k--;
+            s = ((f[q] + static_cast<double>(q) * q) - (f[v[k]] + static_cast<double>(v[k]) * v[k])) / (2.0 * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INF;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; ++q)
+    {
+        while (z[k + 1] < q)
+            k++;
+        d[q] = f[v[k]] == INF ? INF : static_cast<double>(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Function to compute the exact Euclidean distance field of land use type k
+// with the separable linear-time transform: columns first, then rows
+void euclideanDistanceField(const Grid<CellType> &grid, int k, DistanceMaps &distanceMaps)
+{
+    const int rows = grid.rows();
+    const int cols = grid.cols();
+    const int n = max(rows, cols);
+    const double INF = numeric_limits<double>::infinity();
+
+    vector<double> squared(grid.size());
+    vector<double> f(n), d(n), z(n + 1);
+    vector<int> v(n);
+
+    for (int j = 0; j < cols; ++j)
+    {
+        for (int i = 0; i < rows; ++i)
+            f[i] = grid(i, j) == landUseTypes[k] ? 0.0 : INF;
+        squaredDistanceTransform1D(f.data(), rows, d.data(), v.data(), z.data());
+        for (int i = 0; i < rows; ++i)
+            squared[grid.index(i, j)] = d[i];
+    }
+
+    vector<float> distances(grid.size());
+    for (int i = 0; i < rows; ++i)
+    {
+        squaredDistanceTransform1D(&squared[grid.index(i, 0)], cols, d.data(), v.data(), z.data());
+        for (int j = 0; j < cols; ++j)
+            distances[grid.index(i, j)] = d[j] == INF ? numeric_limits<float>::infinity() : static_cast<float>(sqrt(d[j]));
+    }
+
+    quantiseDistanceField(distances, k, distanceMaps);
+}
+
+// Function to compute the weighted distance field of land use type k with
+// Dijkstra over the 8-connected grid. A step between two cells costs the mean
+// of their traversal costs times the chamfer step length (1 or sqrt(2)).
+void weightedDistanceField(const Grid<CellType> &grid, int k, const vector<float> &traversalCosts, DistanceMaps &distanceMaps)
+{
+    const int rows = grid.rows();
+    const int cols = grid.cols();
+    const float INF = numeric_limits<float>::infinity();
+    static const int di[] = {-1, 0, 1, 0, -1, -1, 1, 1};
+    static const int dj[] = {0, 1, 0, -1, -1, 1, -1, 1};
+    static const float stepLength[] = {1, 1, 1, 1, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f};
+
+    vector<float> distances(grid.size(), INF);
+    priority_queue<pair<float, int>, vector<pair<float, int>>, greater<pair<float, int>>> frontier;
+
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (grid[idx] == landUseTypes[k])
+        {
+            distances[idx] = 0.0f;
+            frontier.emplace(0.0f, idx);
+        }
+    }
+
+    while (!frontier.empty())
+    {
+        const float distance = frontier.top().first;
+        const int idx = frontier.top().second;
+        frontier.pop();
+        if (distance > distances[idx])
+            continue; // Stale entry
+
+        const int i = idx / cols;
+        const int j = idx - i * cols;
+        const float cost = traversalCosts[grid[idx]];
+
+        for (int dir = 0; dir < 8; ++dir)
+        {
+            int ni = i + di[dir];
+            int nj = j + dj[dir];
+            if (ni < 0 || ni >= rows || nj < 0 || nj >= cols)
+                continue;
+
+            int n = grid.index(ni, nj);
+            float candidate = distance + 0.5f * (cost + traversalCosts[grid[n]]) * stepLength[dir];
+            if (candidate < distances[n])
+            {
+                distances[n] = candidate;
+                frontier.emplace(candidate, n);
+            }
+        }
+    }
+
+    quantiseDistanceField(distances, k, distanceMaps);
+}
+
+// Function to compute distance maps for all land use types with the selected
+// backend. For MANHATTAN the types are split into groups of one multi-label
+// sweep each; the other backends work on one type at a time. Groups are
+// processed concurrently on options.threads threads (0 = one per type on
+// large grids, a single thread on small ones).
+DistanceMaps computeDistanceMaps(const Grid<CellType> &grid, const DistanceOptions &options = DistanceOptions())
+{
+    DistanceMaps distanceMaps;
+    distanceMaps.rows = grid.rows();
+    distanceMaps.cols = grid.cols();
+    distanceMaps.types = static_cast<int>(landUseTypes.size());
+    distanceMaps.values.assign(static_cast<size_t>(distanceMaps.types) * grid.size(), UNREACHABLE_DISTANCE);
+    distanceMaps.units.assign(distanceMaps.types, 1.0);
+    distanceMaps.landUse = landUseTypes;
+
+    int threads = options.threads;
+    if (threads <= 0)
+    {
+        threads = grid.size() >= (1 << 16) ? static_cast<int>(thread::hardware_concurrency()) : 1;
+    }
+
+    // BFS groups hold at most MAX_SWEEP_LABELS types, other backends one type each
+    const int groupSize = options.metric == MANHATTAN ? MAX_SWEEP_LABELS : 1;
+    const int minGroups = (distanceMaps.types + groupSize - 1) / groupSize;
+    const int groups = max(max(1, minGroups), min(threads, distanceMaps.types));
+    const int numWorkers = min(groups, max(threads, 1));
+
+    auto worker = [&](int w)
+    {
+        for (int g = w; g < groups; g += numWorkers)
+        {
+            const int firstType = g * distanceMaps.types / groups;
+            const int lastType = (g + 1) * distanceMaps.types / groups;
+            for (int k = firstType; k < lastType && options.metric != MANHATTAN; ++k)
+            {
+                if (options.metric == EUCLIDEAN)
+                    euclideanDistanceField(grid, k, distanceMaps);
+                else
+                    weightedDistanceField(grid, k, options.traversalCosts, distanceMaps);
+            }
+            if (options.metric == MANHATTAN)
+                sweepDistanceFields(grid, firstType, lastType, distanceMaps);
+        }
+    };
+
+    vector<thread> workers;
+    for (int w = 1; w < numWorkers; ++w)
+    {
+        workers.emplace_back(worker, w);
+    }
+    worker(0);
+    for (thread &t : workers)
+    {
+        t.join();
+    }
+
+    return distanceMaps;
+}
+
+// Precomputed utility of every cell type at every cell, stored contiguously
+// as values[(type * rows + i) * cols + j]. Rows of non-agent types are zero,
+// so scoring a grid is a plain gather-and-add without maps or branches.
+struct UtilityTable
+{
+    int rows = 0;
+    int cols = 0;
+    vector<double> values;
+    uint32_t activeTypes = 0; // bit t set if the row of type t may be non-zero
+
+    double at(CellType type, int i, int j) const
+    {
+        return values[(static_cast<size_t>(type) * rows + i) * cols + j];
+    }
+
+    // Utility of a type at a row-major cell index
+    double at(CellType type, int idx) const
+    {
+        return values[static_cast<size_t>(type) * rows * cols + idx];
+    }
+
+    size_t memoryBytes() const { return values.capacity() * sizeof(double); }
+};
+
+// Function to calculate the utility of an agent with the given preferences at a cell
+double agentUtility(const DistanceMaps &distanceMaps, const vector<float> &preferences, int idx)
+{
+    double agentScore = 0.0;
+
+    // For each land use type
+    for (int k = 0; k < distanceMaps.types; ++k)
+    {
+        uint16_t distance = distanceMaps.at(k, idx);
+
+        // Avoid division by zero and skip unreachable cells
+        if (distance > 0 && distance != UNREACHABLE_DISTANCE)
+        {
+            agentScore += preferences[k] / (distance * distanceMaps.units[k]);
+        }
+    }
+
+    return agentScore;
+}
+
+// Function to build the utility table from the agent preferences and distance maps
+UtilityTable computeUtilityTable(const DistanceMaps &distanceMaps)
+{
+    const int rows = distanceMaps.rows;
+    const int cols = distanceMaps.cols;
+
+    UtilityTable utility;
+    utility.rows = rows;
+    utility.cols = cols;
+    utility.values.assign(static_cast<size_t>(NUM_CELL_TYPES) * rows * cols, 0.0);
+
+    for (CellType agentType : agentTypes)
+    {
+        const vector<float> &preferences = agentPreferences[agentType];
+        double *row = &utility.values[static_cast<size_t>(agentType) * rows * cols];
+        utility.activeTypes |= 1u << agentType;
+
+        for (int idx = 0; idx < rows * cols; ++idx)
+        {
+            row[idx] = agentUtility(distanceMaps, preferences, idx);
+        }
+    }
+
+    return utility;
+}
+
+// Field pointers and units of a scenario's land use types, resolved once so
+// the kernels below only index arrays. Types without a field get a null
+// pointer and contribute nothing.
+template <class Scenario>
+struct ScenarioFields
+{
+    const uint16_t *fields[Scenario::LAND_USE_COUNT];
+    double units[Scenario::LAND_USE_COUNT];
+
+    explicit ScenarioFields(const DistanceMaps &distanceMaps)
+    {
+        for (int k = 0; k < Scenario::LAND_USE_COUNT; ++k)
+        {
+            int field = distanceMaps.fieldIndex(Scenario::landUseTypes[k]);
+            fields[k] = field >= 0 ? distanceMaps.field(field) : nullptr;
+            units[k] = field >= 0 ? distanceMaps.units[field] : 1.0;
+        }
+    }
+
+    // Score of agent a (index into Scenario::agentTypes) at a cell, with a
+    // fixed trip count over the land use types and constant preferences
+    double agentScore(int a, int idx) const
+    {
+        double score = 0.0;
+        for (int k = 0; k < Scenario::LAND_USE_COUNT; ++k)
+        {
+            uint16_t distance = fields[k] ? fields[k][idx] : UNREACHABLE_DISTANCE;
+            if (distance > 0 && distance != UNREACHABLE_DISTANCE)
+            {
+                score += Scenario::preferences[a][k] / (distance * units[k]);
+            }
+        }
+        return score;
+    }
+};
+
+// Function to build the utility table of a compile-time scenario. Produces the
+// same table as the runtime version when the runtime globals hold the scenario.
+template <class Scenario>
+UtilityTable computeUtilityTable(const DistanceMaps &distanceMaps)
+{
+    const int numCells = distanceMaps.rows * distanceMaps.cols;
+    const ScenarioFields<Scenario> fields(distanceMaps);
+
+    UtilityTable utility;
+    utility.rows = distanceMaps.rows;
+    utility.cols = distanceMaps.cols;
+    utility.values.assign(static_cast<size_t>(NUM_CELL_TYPES) * numCells, 0.0);
+
+    for (int a = 0; a < Scenario::AGENT_COUNT; ++a)
+    {
+        double *row = &utility.values[static_cast<size_t>(Scenario::agentTypes[a]) * numCells];
+        utility.activeTypes |= 1u << Scenario::agentTypes[a];
+        for (int idx = 0; idx < numCells; ++idx)
+        {
+            row[idx] = fields.agentScore(a, idx);
+        }
+    }
+
+    return utility;
+}
+
+// Function to calculate the total score of a compile-time scenario directly
+// from the distance fields, without a utility table. Used where a table would
+// not pay off, e.g. one-off verification of a layout on a very large site.
+template <class Scenario>
+double calculateScore(const Grid<CellType> &grid, const DistanceMaps &distanceMaps)
+{
+    // Agent index of every cell type, -1 for non-agents
+    int agentOf[NUM_CELL_TYPES];
+    fill(begin(agentOf), end(agentOf), -1);
+    for (int a = 0; a < Scenario::AGENT_COUNT; ++a)
+    {
+        agentOf[Scenario::agentTypes[a]] = a;
+    }
+
+    const ScenarioFields<Scenario> fields(distanceMaps);
+    double totalScore = 0.0;
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        int a = agentOf[grid[idx]];
+        if (a >= 0)
+        {
+            totalScore += fields.agentScore(a, idx);
+        }
+    }
+    return totalScore;
+}
+
+// Distance decay kernels for accessibility scoring. K(0) = 1 for each.
+enum AccessibilityKernel
+{
+    GAUSSIAN,    // exp(-d^2 / (2 scale^2)), Euclidean d (separable convolution)
+    EXPONENTIAL, // exp(-(|di| + |dj|) / scale), Manhattan d (separable recursive filter)
+    POWER_LAW    // (1 + d / scale)^-exponent, Euclidean d (FFT convolution)
+};
+
+// Settings for computeAccessibilityFields
+struct AccessibilityOptions
+{
+    AccessibilityKernel kernel = EXPONENTIAL;
+    double scale = 5.0;    // Decay length in cells
+    double exponent = 2.0; // POWER_LAW only
+    int radius = 0;        // Kernel support in cells (a square for GAUSSIAN, a disc for POWER_LAW);
+                           // 0 = 3 scale for GAUSSIAN, the whole site for POWER_LAW. EXPONENTIAL is never truncated.
+};
+
+// Accessibility of every cell to each land use type, summed over all cells
+// of the type with a distance decay kernel: values[k * rows * cols + idx] =
+// sum over sources s of landUse[k] of K(distance(idx, s)).
+struct AccessibilityFields
+{
+    int rows = 0;
+    int cols = 0;
+    int types = 0;
+    vector<double> values;
+    vector<CellType> landUse; // Land use type of each field
+
+    const double *field(int k) const { return &values[static_cast<size_t>(k) * rows * cols]; }
+    double *field(int k) { return &values[static_cast<size_t>(k) * rows * cols]; }
+};
+
+// Function to convolve n values spaced `stride` apart with the symmetric
+// kernel weights[0..radius], zero outside the range
+void convolveLine(double *line, int n, int stride, const vector<double> &weights, vector<double> &scratch)
+{
+    const int radius = static_cast<int>(weights.size()) - 1;
+    scratch.resize(n);
+    for (int q = 0; q < n; ++q)
+        scratch[q] = line[static_cast<size_t>(q) * stride];
+    for (int q = 0; q < n; ++q)
+    {
+        double sum = weights[0] * scratch[q];
+        for (int r = 1; r <= radius; ++r)
+        {
+            if (q - r >= 0)
+                sum += weights[r] * scratch[q - r];
+            if (q + r < n)
+                sum += weights[r] * scratch[q + r];
+        }
+        line[static_cast<size_t>(q) * stride] = sum;
+    }
+}
+
+// Function to convolve n values spaced `stride` apart with decay^|offset| in
+// O(n): a causal and an anti-causal first-order recursion, minus the centre
+// tap counted by both
+void exponentialLine(double *line, int n, int stride, double decay, vector<double> &scratch)
+{
+    scratch.resize(n);
+    double forward = 0.0;
+    for (int q = 0; q < n; ++q)
+    {
+        forward = line[static_cast<size_t>(q) * stride] + decay * forward;
+        scratch[q] = forward;
+    }
+    double backward = 0.0;
+    for (int q = n - 1; q >= 0; --q)
+    {
+        double &value = line[static_cast<size_t>(q) * stride];
+        backward = value + decay * backward;
+        const double input = value;
+        value = scratch[q] + backward - input;
+    }
+}
+
+// Function to run an in-place radix-2 FFT of n (a power of two) values
+// spaced `stride` apart; inverse = true for the unscaled inverse transform
+void fft(complex<double> *data, int n, int stride, bool inverse, vector<complex<double>> &scratch)
+{
+    scratch.resize(n);
+    for (int q = 0, reversed = 0; q < n; ++q)
+    {
+        scratch[reversed] = data[static_cast<size_t>(q) * stride];
+        int bit = n >> 1;
+        for (; reversed & bit; bit >>= 1)
+            reversed ^= bit;
+        reversed |= bit;
+    }
+
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        const double angle = (inverse ? 2.0 : -2.0) * 3.14159265358979323846 / length;
+        const complex<double> step(cos(angle), sin(angle));
+        for (int start = 0; start < n; start += length)
+        {
+            complex<double> twiddle(1.0, 0.0);
+            for (int q = 0; q < length / 2; ++q)
+            {
+                const complex<double> even = scratch[start + q];
+                const complex<double> odd = scratch[start + q + length / 2] * twiddle;
+                scratch[start + q] = even + odd;
+                scratch[start + q + length / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+
+    for (int q = 0; q < n; ++q)
+        data[static_cast<size_t>(q) * stride] = scratch[q];
+}
+
+// Function to run a 2D FFT of a rows x cols (powers of two) array
+void fft2D(vector<complex<double>> &data, int rows, int cols, bool inverse, vector<complex<double>> &scratch)
+{
+    for (int i = 0; i < rows; ++i)
+        fft(&data[static_cast<size_t>(i) * cols], cols, 1, inverse, scratch);
+    for (int j = 0; j < cols; ++j)
+        fft(&data[j], rows, cols, inverse, scratch);
+}
+
+// Function to compute the accessibility fields of all land use types.
+// GAUSSIAN and EXPONENTIAL kernels are separable and are applied as a row
+// pass and a column pass, O(cells * radius) and O(cells) respectively.
+// POWER_LAW is not separable and is convolved by FFT on a zero-padded
+// array, two types at a time as the real and imaginary parts of one
+// transform (the kernel is real and symmetric, so they do not mix).
+// Runtime is independent of the number of land use cells.
+AccessibilityFields computeAccessibilityFields(const Grid<CellType> &grid, const AccessibilityOptions &options = AccessibilityOptions())
+{
+    const int rows = grid.rows();
+    const int cols = grid.cols();
+    const size_t numCells = static_cast<size_t>(grid.size());
+
+    AccessibilityFields fields;
+    fields.rows = rows;
+    fields.cols = cols;
+    fields.types = static_cast<int>(landUseTypes.size());
+    fields.landUse = landUseTypes;
+    fields.values.assign(fields.types * numCells, 0.0);
+
+    // Indicator rasters of the land use types
+    for (int k = 0; k < fields.types; ++k)
+    {
+        double *field = fields.field(k);
+        for (size_t idx = 0; idx < numCells; ++idx)
+            field[idx] = grid[static_cast<int>(idx)] == landUseTypes[k] ? 1.0 : 0.0;
+    }
+
+    if (options.kernel == GAUSSIAN || options.kernel == EXPONENTIAL)
+    {
+        const int radius = options.radius > 0 ? options.radius : static_cast<int>(ceil(3.0 * options.scale));
+        vector<double> weights(radius + 1);
+        for (int r = 0; r <= radius; ++r)
+            weights[r] = exp(-0.5 * r * r / (options.scale * options.scale));
+        const double decay = exp(-1.0 / options.scale);
+
+        vector<double> scratch;
+        for (int k = 0; k < fields.types; ++k)
+        {
+            double *field = fields.field(k);
+            for (int i = 0; i < rows; ++i)
+            {
+                if (options.kernel == GAUSSIAN)
+                    convolveLine(field + static_cast<size_t>(i) * cols, cols, 1, weights, scratch);
+                else
+                    exponentialLine(field + static_cast<size_t>(i) * cols, cols, 1, decay, scratch);
+            }
+            for (int j = 0; j < cols; ++j)
+            {
+                if (options.kernel == GAUSSIAN)
+                    convolveLine(field + j, rows, cols, weights, scratch);
+                else
+                    exponentialLine(field + j, rows, cols, decay, scratch);
+            }
+        }
+        return fields;
+    }
+
+    // POWER_LAW: linear convolution needs padding by the kernel support
+    const int radiusRows = options.radius > 0 ? min(options.radius, rows - 1) : rows - 1;
+    const int radiusCols = options.radius > 0 ? min(options.radius, cols - 1) : cols - 1;
+    int paddedRows = 1, paddedCols = 1;
+    while (paddedRows < rows + radiusRows)
+        paddedRows <<= 1;
+    while (paddedCols < cols + radiusCols)
+        paddedCols <<= 1;
+    const size_t paddedCells = static_cast<size_t>(paddedRows) * paddedCols;
+
+    // Kernel spectrum, with negative offsets wrapped to the end of each axis
+    vector<complex<double>> kernel(paddedCells, 0.0);
+    for (int di = -radiusRows; di <= radiusRows; ++di)
+    {
+        for (int dj = -radiusCols; dj <= radiusCols; ++dj)
+        {
+            const double d = sqrt(static_cast<double>(di) * di + static_cast<double>(dj) * dj);
+            if (options.radius > 0 && d > options.radius)
+                continue;
+            const size_t i = (di + paddedRows) % paddedRows;
+            const size_t j = (dj + paddedCols) % paddedCols;
+            kernel[i * paddedCols + j] = pow(1.0 + d / options.scale, -options.exponent);
+        }
+    }
+    vector<complex<double>> scratch;
+    fft2D(kernel, paddedRows, paddedCols, false, scratch);
+
+    vector<complex<double>> work(paddedCells);
+    for (int k = 0; k < fields.types; k += 2)
+    {
+        const bool pair = k + 1 < fields.types;
+        fill(work.begin(), work.end(), complex<double>(0.0, 0.0));
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                const size_t idx = static_cast<size_t>(i) * cols + j;
+                work[static_cast<size_t>(i) * paddedCols + j] =
+                    complex<double>(fields.field(k)[idx], pair ? fields.field(k + 1)[idx] : 0.0);
+            }
+        }
+
+        fft2D(work, paddedRows, paddedCols, false, scratch);
+        for (size_t q = 0; q < paddedCells; ++q)
+            work[q] *= kernel[q];
+        fft2D(work, paddedRows, paddedCols, true, scratch);
+
+        const double scale = 1.0 / paddedCells;
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                const size_t idx = static_cast<size_t>(i) * cols + j;
+                const complex<double> value = work[static_cast<size_t>(i) * paddedCols + j] * scale;
+                fields.field(k)[idx] = value.real();
+                if (pair)
+                    fields.field(k + 1)[idx] = value.imag();
+            }
+        }
+    }
+    return fields;
+}
+
+// Function to build the utility table of the gravity model: the utility of
+// an agent at a cell is the preference-weighted sum of its accessibility to
+// each land use type. Scoring and swap deltas then work exactly as with the
+// nearest-cell model.
+UtilityTable computeUtilityTable(const AccessibilityFields &fields)
+{
+    const size_t numCells = static_cast<size_t>(fields.rows) * fields.cols;
+
+    UtilityTable utility;
+    utility.rows = fields.rows;
+    utility.cols = fields.cols;
+    utility.values.assign(NUM_CELL_TYPES * numCells, 0.0);
+
+    for (CellType agentType : agentTypes)
+    {
+        const vector<float> &preferences = agentPreferences[agentType];
+        double *row = &utility.values[agentType * numCells];
+        utility.activeTypes |= 1u << agentType;
+        for (int k = 0; k < fields.types; ++k)
+        {
+            const double preference = preferences[k];
+            const double *field = fields.field(k);
+            for (size_t idx = 0; idx < numCells; ++idx)
+                row[idx] += preference * field[idx];
+        }
+    }
+
+    return utility;
+}
+
+// Total score kernel: gathers the utility of each cell's type at that cell.
+// FIXED_ROWS/FIXED_COLS > 0 fix the grid dimensions at compile time.
+template <int FIXED_ROWS, int FIXED_COLS>
+struct ScoreKernel
+{
+    static double run(const uint8_t *cells, const double *utility, int runtimeRows, int runtimeCols)
+    {
+        const int numCells = (FIXED_ROWS > 0 ? FIXED_ROWS : runtimeRows) * (FIXED_COLS > 0 ? FIXED_COLS : runtimeCols);
+        double totalScore = 0.0;
+
+        for (int idx = 0; idx < numCells; ++idx)
+        {
+            totalScore += utility[static_cast<size_t>(cells[idx]) * numCells + idx];
+        }
+
+        return totalScore;
+    }
+};
+
+// Function to calculate total score based on distances to land use types.
+// Small fixed-size sites use the compile-time kernel; everything else goes to
+// the vectorised gather kernel (SimdKernels.h), which skips non-agent cells.
+double calculateScore(const Grid<CellType> &grid, const UtilityTable &utility)
+{
+    if (isDispatchedGridSize(grid.rows(), grid.cols()))
+    {
+        return dispatchGridSize<ScoreKernel>(grid.rows(), grid.cols(), grid.data(), utility.values.data(), grid.rows(), grid.cols());
+    }
+    return gatherScore(grid.data(), utility.values.data(), grid.size(), utility.activeTypes);
+}
+
+// Function to calculate the change in total score caused by swapping two cells.
+// With fixed distance maps only the two swapped cells change their contribution,
+// so the cost is four table lookups instead of a full grid pass.
+double swapDelta(const Grid<CellType> &grid, int a, int b, const UtilityTable &utility)
+{
+    CellType first = grid[a];
+    CellType second = grid[b];
+    if (first == second)
+    {
+        return 0.0;
+    }
+
+    return utility.at(second, a) + utility.at(first, b) -
+           utility.at(first, a) - utility.at(second, b);
+}
+
+double swapDelta(const Grid<CellType> &grid, int x1, int y1, int x2, int y2, const UtilityTable &utility)
+{
+    return swapDelta(grid, grid.index(x1, y1), grid.index(x2, y2), utility);
+}
+
+// Utility table quantised to Q = uint8_t or uint16_t, for sites where the
+// double table does not fit in memory. Only the agent rows are stored, each
+// as offset + step * q with its own range, so the uint16_t table of four
+// agent types takes 8 bytes per cell instead of the 72 of UtilityTable.
+// Every value is within maxError() of the original. Build it straight from
+// the distance maps, so the double table never exists.
+template <typename Q>
+struct QuantisedUtilityTable
+{
+    int rows = 0;
+    int cols = 0;
+    int rowOf[NUM_CELL_TYPES]; // Stored row of each type, -1 for non-agent types (utility 0)
+    vector<double> offset;     // Per stored row
+    vector<double> step;       // Per stored row
+    vector<Q> values;          // values[row * rows * cols + idx]
+
+    double at(CellType type, int idx) const
+    {
+        const int row = rowOf[type];
+        return row < 0 ? 0.0 : offset[row] + step[row] * values[static_cast<size_t>(row) * rows * cols + idx];
+    }
+
+    double maxError() const
+    {
+        double error = 0.0;
+        for (double s : step)
+            error = max(error, 0.5 * s);
+        return error;
+    }
+
+    size_t memoryBytes() const { return values.capacity() * sizeof(Q) + (offset.capacity() + step.capacity()) * sizeof(double); }
+};
+
+// Function to quantise the agent rows of a utility, one row at a time: a
+// min/max pass over the row, then a quantising pass. rowValues(agentType)
+// returns the utility of that agent type by cell index.
+template <typename Q, typename RowValues>
+QuantisedUtilityTable<Q> quantiseUtilityRows(int rows, int cols, RowValues rowValues)
+{
+    const size_t numCells = static_cast<size_t>(rows) * cols;
+    const double levels = numeric_limits<Q>::max();
+
+    QuantisedUtilityTable<Q> quantised;
+    quantised.rows = rows;
+    quantised.cols = cols;
+    fill(begin(quantised.rowOf), end(quantised.rowOf), -1);
+    quantised.values.resize(agentTypes.size() * numCells);
+
+    for (size_t row = 0; row < agentTypes.size(); ++row)
+    {
+        const CellType agentType = agentTypes[row];
+        const auto value = rowValues(agentType);
+        double low = numCells ? value(0) : 0.0;
+        double high = low;
+        for (size_t idx = 1; idx < numCells; ++idx)
+        {
+            const double v = value(idx);
+            low = min(low, v);
+            high = max(high, v);
+        }
+        const double step = high > low ? (high - low) / levels : 1.0;
+
+        quantised.rowOf[agentType] = static_cast<int>(row);
+        quantised.offset.push_back(low);
+        quantised.step.push_back(step);
+        Q *target = &quantised.values[row * numCells];
+        for (size_t idx = 0; idx < numCells; ++idx)
+            target[idx] = static_cast<Q>(min((value(idx) - low) / step + 0.5, levels));
+    }
+    return quantised;
+}
+
+// Function to build the quantised table from the agent preferences and
+// distance maps. Each utility is computed twice (range, then value) rather
+// than stored, so the peak memory is the quantised table itself.
+template <typename Q>
+QuantisedUtilityTable<Q> quantiseUtilityTable(const DistanceMaps &distanceMaps)
+{
+    return quantiseUtilityRows<Q>(distanceMaps.rows, distanceMaps.cols, [&](CellType agentType)
+                                  {
+        const vector<float> &preferences = agentPreferences[agentType];
+        return [&distanceMaps, &preferences](size_t idx)
+        { return agentUtility(distanceMaps, preferences, static_cast<int>(idx)); }; });
+}
+
+// Function to quantise an existing utility table
+template <typename Q>
+QuantisedUtilityTable<Q> quantiseUtilityTable(const UtilityTable &utility)
+{
+    return quantiseUtilityRows<Q>(utility.rows, utility.cols, [&](CellType agentType)
+                                  {
+        const double *source = &utility.values[agentType * static_cast<size_t>(utility.rows) * utility.cols];
+        return [source](size_t idx)
+        { return source[idx]; }; });
+}
+
+// Function to calculate the total score of a packed grid with a quantised table
+template <typename Q>
+double calculateScore(const PackedGrid<CellType> &grid, const QuantisedUtilityTable<Q> &utility)
+{
+    double totalScore = 0.0;
+    for (int idx = 0; idx < grid.size(); ++idx)
+        totalScore += utility.at(grid[idx], idx);
+    return totalScore;
+}
+
+// Function to calculate the change in total score caused by swapping two
+// cells of a packed grid.
+template <typename Q>
+double swapDelta(const PackedGrid<CellType> &grid, int a, int b, const QuantisedUtilityTable<Q> &utility)
+{
+    CellType first = grid[a];
+    CellType second = grid[b];
+    if (first == second)
+    {
+        return 0.0;
+    }
+
+    return utility.at(second, a) + utility.at(first, b) -
+           utility.at(first, a) - utility.at(second, b);
+}
+
+// Manhattan distance maps that follow edits of the fixed land use cells, so a
+// planner can move a TRANSPORT stop or redraw a ROAD without recomputing
+// every field. Only the fields of the removed and the added type change:
+// - Adding a source of type k runs a BFS wavefront from the new cell that
+//   stops wherever it no longer shortens the existing distance.
+// - Removing a source of type k first invalidates, in BFS order from the
+//   removed cell, every cell whose distance has no remaining support (no
+//   valid neighbour one step closer), then repairs the invalidated region
+//   with a Dijkstra wavefront seeded from its valid boundary.
+// Both touch only the cells whose distance changes plus their neighbours.
+// setCell reports those cells so the utility table and the score can be
+// patched with patchUtility instead of being rebuilt.
+class DynamicDistanceMaps
+{
+public:
+    explicit DynamicDistanceMaps(const Grid<CellType> &grid)
+        : maps_(computeDistanceMaps(grid)), state_(grid.size(), 0), changedStamp_(grid.size(), 0)
+    {
+    }
+
+    const DistanceMaps &maps() const { return maps_; }
+
+    // Function to change cell idx of the grid to type and repair the distance
+    // fields. Returns the cells whose distance to some land use type changed.
+    const vector<int> &setCell(Grid<CellType> &grid, int idx, CellType type)
+    {
+        changed_.clear();
+        if (++stamp_ == 0)
+        {
+            fill(changedStamp_.begin(), changedStamp_.end(), 0);
+            stamp_ = 1;
+        }
+
+        const CellType previous = grid[idx];
+        if (previous == type)
+            return changed_;
+        grid.set(idx, type);
+
+        const int removed = maps_.fieldIndex(previous);
+        const int added = maps_.fieldIndex(type);
+        if (removed >= 0)
+            removeSource(removed, idx);
+        if (added >= 0)
+            addSource(added, idx);
+        return changed_;
+    }
+
+private:
+    enum CellState : uint8_t
+    {
+        VALID,
+        INVALID // Lost its support during a removal, waiting for the repair
+    };
+
+    void markChanged(int idx)
+    {
+        if (changedStamp_[idx] != stamp_)
+        {
+            changedStamp_[idx] = stamp_;
+            changed_.push_back(idx);
+        }
+    }
+
+    // Neighbours of a cell in the 4-connected grid, -1 outside
+    void neighbours(int idx, int out[4]) const
+    {
+        const int cols = maps_.cols;
+        const int i = idx / cols;
+        const int j = idx - i * cols;
+        out[0] = i > 0 ? idx - cols : -1;
+        out[1] = j < cols - 1 ? idx + 1 : -1;
+        out[2] = i < maps_.rows - 1 ? idx + cols : -1;
+        out[3] = j > 0 ? idx - 1 : -1;
+    }
+
+    static uint16_t step(uint16_t distance)
+    {
+        return distance < UNREACHABLE_DISTANCE - 1 ? distance + 1 : UNREACHABLE_DISTANCE - 1;
+    }
+
+    // Bounded BFS wavefront from a new source of field k
+    void addSource(int k, int source)
+    {
+        uint16_t *field = maps_.field(k);
+        if (field[source] == 0)
+            return;
+
+        field[source] = 0;
+        markChanged(source);
+        queue_.assign(1, source);
+        for (size_t head = 0; head < queue_.size(); ++head)
+        {
+            const int idx = queue_[head];
+            const uint16_t distance = step(field[idx]);
+            int next[4];
+            neighbours(idx, next);
+            for (int n : next)
+            {
+                if (n >= 0 && distance < field[n])
+                {
+                    field[n] = distance;
+                    markChanged(n);
+                    queue_.push_back(n);
+                }
+            }
+        }
+    }
+
+    // Invalidate the cells that depended on a removed source of field k, then
+    // repair them from the valid cells around them
+    void removeSource(int k, int source)
+    {
+        uint16_t *field = maps_.field(k);
+
+        // Invalidation in BFS order: the queue holds non-decreasing old
+        // distances, so all cells of a level are invalidated before any cell
+        // of the next level checks its support
+        state_[source] = INVALID;
+        queue_.assign(1, source);
+        for (size_t head = 0; head < queue_.size(); ++head)
+        {
+            const int idx = queue_[head];
+            const uint16_t distance = field[idx];
+            int next[4];
+            neighbours(idx, next);
+            for (int n : next)
+            {
+                if (n < 0 || state_[n] != VALID || field[n] != step(distance))
+                    continue;
+
+                bool supported = false;
+                int around[4];
+                neighbours(n, around);
+                for (int m : around)
+                {
+                    if (m >= 0 && state_[m] == VALID && field[m] != UNREACHABLE_DISTANCE && step(field[m]) == field[n])
+                    {
+                        supported = true;
+                        break;
+                    }
+                }
+                if (!supported)
+                {
+                    state_[n] = INVALID;
+                    queue_.push_back(n);
+                }
+            }
+        }
+
+        // Seed the repair with the valid boundary of the invalidated region
+        priority_queue<pair<uint16_t, int>, vector<pair<uint16_t, int>>, greater<pair<uint16_t, int>>> frontier;
+        for (int idx : queue_)
+        {
+            previous_.push_back(field[idx]);
+            field[idx] = UNREACHABLE_DISTANCE;
+        }
+        for (int idx : queue_)
+        {
+            int next[4];
+            neighbours(idx, next);
+            for (int n : next)
+            {
+                if (n >= 0 && state_[n] == VALID && field[n] != UNREACHABLE_DISTANCE && step(field[n]) < field[idx])
+                {
+                    field[idx] = step(field[n]);
+                }
+            }
+            if (field[idx] != UNREACHABLE_DISTANCE)
+                frontier.emplace(field[idx], idx);
+        }
+
+        // Dijkstra over the invalidated cells only
+        while (!frontier.empty())
+        {
+            const uint16_t distance = frontier.top().first;
+            const int idx = frontier.top().second;
+            frontier.pop();
+            if (distance > field[idx])
+                continue; // Stale entry
+
+            int next[4];
+            neighbours(idx, next);
+            for (int n : next)
+            {
+                if (n >= 0 && state_[n] != VALID && step(distance) < field[n])
+                {
+                    field[n] = step(distance);
+                    frontier.emplace(field[n], n);
+                }
+            }
+        }
+
+        for (size_t q = 0; q < queue_.size(); ++q)
+        {
+            const int idx = queue_[q];
+            state_[idx] = VALID;
+            if (field[idx] != previous_[q])
+                markChanged(idx);
+        }
+        previous_.clear();
+    }
+
+    DistanceMaps maps_;
+    vector<uint8_t> state_;         // CellState of every cell
+    vector<int> queue_;             // BFS queue, then the invalidated cells
+    vector<uint16_t> previous_;     // Distances of the invalidated cells before the repair
+    vector<uint32_t> changedStamp_; // Cells already in changed_ for the current edit
+    uint32_t stamp_ = 0;
+    vector<int> changed_;
+};
+
+// Function to patch the utility table at the cells reported by
+// DynamicDistanceMaps::setCell after grid[edited] was changed from
+// `previous`. Returns the change in the total score of the grid, so the
+// current score can be updated without a full rescore.
+double patchUtility(UtilityTable &utility, const DistanceMaps &distanceMaps, const Grid<CellType> &grid, int edited, CellType previous, const vector<int> &changed)
+{
+    const size_t numCells = static_cast<size_t>(utility.rows) * utility.cols;
+
+    // The edited cell loses its old contribution (an agent may have been
+    // replaced) and gains its new one after the patch
+    double delta = -utility.at(previous, edited);
+    for (int idx : changed)
+    {
+        for (CellType agentType : agentTypes)
+        {
+            double &value = utility.values[agentType * numCells + idx];
+            const double updated = agentUtility(distanceMaps, agentPreferences[agentType], idx);
+            if (grid[idx] == agentType && idx != edited)
+                delta += updated - value;
+            value = updated;
+        }
+    }
+    return delta + utility.at(grid[edited], edited);
+}
+
+// Function to check whether a cell holds an agent type
+bool isAgentType(CellType cell)
+{
+    return find(agentTypes.begin(), agentTypes.end(), cell) != agentTypes.end();
+}
+
+// Function to collect the indices of all agent cells, i.e. the cells the
+// optimiser may swap. Swaps only exchange agent types between agent cells,
+// so this set stays valid for the whole optimisation.
+vector<int> collectAgentCells(const Grid<CellType> &grid)
+{
+    vector<int> agentCells;
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (isAgentType(grid[idx]))
+        {
+            agentCells.push_back(idx);
+        }
+    }
+    return agentCells;
+}
+
+// Function to check whether the agent cells hold at least two different types,
+// which is required for any swap to change the grid
+bool hasMixedAgents(const Grid<CellType> &grid, const vector<int> &agentCells)
+{
+    for (int cell : agentCells)
+    {
+        if (grid[cell] != grid[agentCells.front()])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to draw a swap between two agent cells of different types.
+// Same-type pairs (including a cell with itself) always give a zero delta,
+// so they are redrawn rather than evaluated.
+void proposeSwap(const Grid<CellType> &grid, const vector<int> &agentCells, Rng &rng, int &a, int &b)
+{
+    const uint32_t numAgentCells = static_cast<uint32_t>(agentCells.size());
+    do
+    {
+        a = agentCells[rng.uniform(numAgentCells)];
+        b = agentCells[rng.uniform(numAgentCells)];
+    } while (grid[a] == grid[b]);
+}
+
+// Energy of the land use model for Annealer (see Annealer.h): swaps of two
+// agent cells of different types, scored against the utility table
+struct LandUseEnergy
+{
+    const UtilityTable &utility;
+    const vector<int> &agentCells;
+
+    CellSwap propose(const Grid<CellType> &grid, Rng &rng) const
+    {
+        CellSwap move;
+        proposeSwap(grid, agentCells, rng, move.a, move.b);
+        return move;
+    }
+
+    double delta(const Grid<CellType> &grid, const CellSwap &move) const { return swapDelta(grid, move.a, move.b, utility); }
+    double score(const Grid<CellType> &grid) const { return calculateScore(grid, utility); }
+
+    // Batched proposals (Annealer::runBatched): the candidates are drawn in
+    // stages, prefetching what the next stage reads, so the cache misses of
+    // a batch overlap. Same-type pairs are redrawn one at a time as in
+    // proposeSwap, so every candidate is still a uniform draw.
+    void proposeBatch(const Grid<CellType> &grid, Rng &rng, CellSwap *moves, int count) const
+    {
+        const uint32_t numAgentCells = static_cast<uint32_t>(agentCells.size());
+        for (int k = 0; k < count; ++k)
+        {
+            moves[k].a = rng.uniform(numAgentCells);
+            moves[k].b = rng.uniform(numAgentCells);
+            prefetchRead(&agentCells[moves[k].a]);
+            prefetchRead(&agentCells[moves[k].b]);
+        }
+        for (int k = 0; k < count; ++k)
+        {
+            moves[k].a = agentCells[moves[k].a];
+            moves[k].b = agentCells[moves[k].b];
+            prefetchRead(grid.data() + moves[k].a);
+            prefetchRead(grid.data() + moves[k].b);
+        }
+        const size_t numCells = grid.size();
+        for (int k = 0; k < count; ++k)
+        {
+            CellSwap &move = moves[k];
+            if (grid[move.a] == grid[move.b])
+            {
+                proposeSwap(grid, agentCells, rng, move.a, move.b);
+            }
+            prefetchRead(&utility.values[grid[move.b] * numCells + move.a]);
+            prefetchRead(&utility.values[grid[move.a] * numCells + move.b]);
+            prefetchRead(&utility.values[grid[move.a] * numCells + move.a]);
+            prefetchRead(&utility.values[grid[move.b] * numCells + move.b]);
+        }
+    }
+
+    // Deltas of a batch with the vectorised kernel (SimdKernels.h)
+    void deltas(const Grid<CellType> &grid, const CellSwap *moves, int count, double *out) const
+    {
+        int first[ANNEAL_MAX_BATCH];
+        int second[ANNEAL_MAX_BATCH];
+        for (int k = 0; k < count; ++k)
+        {
+            first[k] = moves[k].a;
+            second[k] = moves[k].b;
+        }
+        swapDeltas(grid.data(), utility.values.data(), NUM_CELL_TYPES, grid.size(), first, second, count, out);
+    }
+};
+
+// Progress of a running optimisation, handed to an AnnealObserver
+struct AnnealProgress
+{
+    int64_t iteration;
+    double temperature;
+    double progress; // Fraction of the cooling schedule completed, 0..1
+    double currentScore;
+    double bestScore;
+};
+
+// Hook called by optimiseGrid every `interval` iterations. Returning false
+// stops the optimisation early; the best grid found so far is still returned.
+class AnnealObserver
+{
+public:
+    virtual ~AnnealObserver() = default;
+    virtual bool onProgress(const AnnealProgress &progress) = 0;
+
+    int interval = 1000;
+};
+
+// Annealer hooks of annealGrid: checkpoints, metrics, the periodic rescore
+// and the observer
+struct LandUseAnnealHooks
+{
+    AnnealState<CellType> &state;
+    const UtilityTable &utility;
+    AnnealObserver *observer;
+    OptimiserMetrics *metrics;
+    CheckpointWriter<CellType> *checkpoints;
+    int64_t firstIteration;
+
+    // Copy the loop position of the annealer back into the state
+    template <class A>
+    void save(A &annealer)
+    {
+        state.iteration = annealer.iteration;
+        state.temperature = annealer.temperature;
+        state.currentScore = annealer.currentScore;
+        state.bestScore = annealer.bestScore;
+        annealer.rng().getState(state.rngState);
+        state.acceptance = annealer.metropolis().state();
+    }
+
+    // Snapshot the state as it is between two iterations
+    template <class A>
+    void beforeStep(A &annealer)
+    {
+        if (checkpoints && annealer.iteration % checkpoints->interval() == 0 && annealer.iteration != firstIteration)
+        {
+            annealer.syncBest();
+            annealer.discardBatch();
+            save(annealer);
+            checkpoints->submit(state);
+        }
+    }
+
+    template <class A>
+    void afterStep(A &, bool accepted, double delta)
+    {
+        METRICS_STEP(metrics, accepted, accepted ? delta : 0.0);
+    }
+
+    template <class A>
+    bool afterIteration(A &annealer)
+    {
+        const int64_t iteration = annealer.iteration;
+
+        // Periodic full rescore to correct floating point drift of the accumulated deltas
+        if (state.rescoreInterval > 0 && iteration > 0 && iteration % state.rescoreInterval == 0)
+        {
+            double exactScore = calculateScore(annealer.state(), utility);
+            METRICS_RESCORE(metrics, exactScore - annealer.currentScore);
+            annealer.currentScore = exactScore;
+        }
+
+        METRICS_SAMPLE(metrics, iteration, annealer.temperature, annealer.currentScore, annealer.bestScore);
+
+        // Report progress, and stop early if the observer asks to
+        if (observer && iteration % observer->interval == 0)
+        {
+            AnnealProgress progress = {iteration, annealer.temperature, annealer.schedule().progress(iteration, annealer.temperature),
+                                       annealer.currentScore, annealer.bestScore};
+            return observer->onProgress(progress);
+        }
+        return true;
+    }
+};
+
+// Function to run the annealing loop on a state until the schedule (see
+// Schedules.h) ends or the observer stops it, starting from state.iteration,
+// so a state loaded from a checkpoint continues exactly where it was saved.
+// Every interval() iterations the state is handed to _checkpoints if given.
+// Returns the total number of iterations of the run.
+template <class Schedule>
+int64_t annealGrid(
+    AnnealState<CellType> &state,
+    const UtilityTable &utility,
+    Rng &rng,
+    Schedule &schedule,
+    AnnealObserver *_observer = nullptr,
+    OptimiserMetrics *_metrics = nullptr,
+    CheckpointWriter<CellType> *_checkpoints = nullptr)
+{
+    // Swap candidates are drawn uniformly from the agent cells only
+    const vector<int> agentCells = collectAgentCells(state.grid);
+    if (!hasMixedAgents(state.grid, agentCells))
+    {
+        return state.iteration; // Every swap would leave the grid unchanged
+    }
+
+    const LandUseEnergy energy = {utility, agentCells};
+    Metropolis metropolis(state.acceptance);
+    Annealer<Grid<CellType>, CellSwap, LandUseEnergy, Schedule> annealer(state.grid, &state.bestGrid, energy, schedule, rng, metropolis);
+    annealer.iteration = state.iteration;
+    annealer.temperature = state.temperature;
+    annealer.currentScore = state.currentScore;
+    annealer.bestScore = state.bestScore;
+    LandUseAnnealHooks hooks = {state, utility, _observer, _metrics, _checkpoints, state.iteration};
+
+    METRICS_BEGIN(_metrics, PHASE_ANNEAL);
+    if (state.batchSize > 1)
+    {
+        annealer.runBatched(hooks, state.batchSize);
+    }
+    else
+    {
+        annealer.run(hooks);
+    }
+    METRICS_END(_metrics, PHASE_ANNEAL);
+
+    hooks.save(annealer);
+    return annealer.iteration;
+}
+
+// Simulated Annealing Optimisation. Returns the number of iterations run.
+// Move counters, anneal time and the score trace go to _metrics if given,
+// periodic checkpoints to _checkpoints (see resumeOptimisation).
+// _batchSize > 1 draws and scores up to that many candidate swaps at a time
+// (at most ANNEAL_MAX_BATCH, see Annealer::runBatched), which makes the low
+// temperature part of the run, where most swaps are rejected, much faster.
+// The batches shrink while most swaps are accepted, but small sites with a
+// high acceptance rate can still run somewhat slower than with single
+// proposals.
+int64_t optimiseGrid(
+    Grid<CellType> &grid,
+    const UtilityTable &utility,
+    Rng &rng,
+    double _temperature = 1000.0,
+    double _cooldown = 1.0,
+    double _coolingRate = 0.003,
+    int _rescoreInterval = 0,
+    AnnealObserver *_observer = nullptr,
+    OptimiserMetrics *_metrics = nullptr,
+    CheckpointWriter<CellType> *_checkpoints = nullptr,
+    int _batchSize = 1)
+{
+    AnnealState<CellType> state;
+    state.grid = grid;
+    state.bestGrid = grid;
+    state.temperature = state.initialTemperature = _temperature;
+    state.cooldown = _cooldown;
+    state.coolingRate = _coolingRate;
+    state.rescoreInterval = _rescoreInterval;
+    state.batchSize = _batchSize;
+    state.currentScore = state.bestScore = calculateScore(grid, utility);
+
+    GeometricSchedule schedule(_temperature, _cooldown, _coolingRate);
+    const int64_t iterations = annealGrid(state, utility, rng, schedule, _observer, _metrics, _checkpoints);
+    grid = state.bestGrid;
+    return iterations;
+}
+
+// Simulated Annealing Optimisation with any schedule from Schedules.h, e.g.
+// DeadlineSchedule to meet a latency budget or Reheating<AdaptiveSchedule>.
+// The best grid found is returned however the schedule ends the run.
+// Returns the number of iterations run.
+template <class Schedule>
+int64_t optimiseWithSchedule(
+    Grid<CellType> &grid,
+    const UtilityTable &utility,
+    Rng &rng,
+    Schedule schedule,
+    int _rescoreInterval = 0,
+    AnnealObserver *_observer = nullptr,
+    OptimiserMetrics *_metrics = nullptr)
+{
+    AnnealState<CellType> state;
+    state.grid = grid;
+    state.bestGrid = grid;
+    state.temperature = state.initialTemperature = schedule.initialTemperature();
+    state.rescoreInterval = _rescoreInterval;
+    state.currentScore = state.bestScore = calculateScore(grid, utility);
+
+    const int64_t iterations = annealGrid(state, utility, rng, schedule, _observer, _metrics);
+    grid = state.bestGrid;
+    return iterations;
+}
+
+// Function to continue an optimisation from a checkpoint written by
+// optimiseGrid (geometric schedule). rng is restored to the saved stream, so the final grid, score
+// and rng state are bit-identical to those of the uninterrupted run. Returns
+// the total number of iterations, or -1 if the checkpoint cannot be loaded.
+int64_t resumeOptimisation(
+    const string &checkpointPath,
+    Grid<CellType> &grid,
+    const UtilityTable &utility,
+    Rng &rng,
+    string &error,
+    AnnealObserver *_observer = nullptr,
+    OptimiserMetrics *_metrics = nullptr,
+    CheckpointWriter<CellType> *_checkpoints = nullptr)
+{
+    AnnealState<CellType> state;
+    if (!loadCheckpoint(checkpointPath, state, NUM_CELL_TYPES, error))
+    {
+        return -1;
+    }
+    if (state.grid.rows() != utility.rows || state.grid.cols() != utility.cols)
+    {
+        error = "checkpoint " + checkpointPath + " does not match the site dimensions";
+        return -1;
+    }
+
+    rng.setState(state.rngState);
+    GeometricSchedule schedule(state.initialTemperature, state.cooldown, state.coolingRate);
+    const int64_t iterations = annealGrid(state, utility, rng, schedule, _observer, _metrics, _checkpoints);
+    grid = state.bestGrid;
+    return iterations;
+}
+
+// Energy of the land use model on a packed grid for Annealer: swaps of two
+// random cells, redrawn until both hold different agent types
+template <typename Q>
+struct PackedEnergy
+{
+    const QuantisedUtilityTable<Q> &utility;
+
+    CellSwap propose(const PackedGrid<CellType> &grid, Rng &rng) const
+    {
+        const uint32_t numCells = static_cast<uint32_t>(grid.size());
+        CellSwap move;
+        do
+        {
+            move.a = rng.uniform(numCells);
+            move.b = rng.uniform(numCells);
+        } while (utility.rowOf[grid[move.a]] < 0 || utility.rowOf[grid[move.b]] < 0 || grid[move.a] == grid[move.b]);
+        return move;
+    }
+
+    double delta(const PackedGrid<CellType> &grid, const CellSwap &move) const { return swapDelta(grid, move.a, move.b, utility); }
+    double score(const PackedGrid<CellType> &grid) const { return calculateScore(grid, utility); }
+};
+
+// Simulated Annealing Optimisation of a packed grid with a quantised utility
+// table, for sites too large for Grid and UtilityTable. Swap candidates are
+// random cells, redrawn until both hold different agent types, so no list of
+// agent cells is kept either. The best grid is snapshotted once per sweep
+// (grid.size() proposals) rather than on every new best, as a copy of a huge
+// grid costs far more than a sweep's worth of improvement. Returns the number
+// of iterations run.
+template <typename Q>
+int64_t optimisePackedGrid(
+    PackedGrid<CellType> &grid,
+    const QuantisedUtilityTable<Q> &utility,
+    Rng &rng,
+    double _temperature = 1000.0,
+    double _cooldown = 1.0,
+    double _coolingRate = 0.003)
+{
+    // Any agent at all, and two different types, or every swap is a no-op
+    bool mixed = false;
+    CellType firstAgent = EMPTY;
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (utility.rowOf[grid[idx]] >= 0)
+        {
+            mixed = mixed || (firstAgent != EMPTY && grid[idx] != firstAgent);
+            firstAgent = firstAgent == EMPTY ? grid[idx] : firstAgent;
+        }
+    }
+    if (!mixed)
+    {
+        return 0;
+    }
+
+    const PackedEnergy<Q> energy = {utility};
+    PackedGrid<CellType> bestGrid = grid;
+    GeometricSchedule schedule(_temperature, _cooldown, _coolingRate);
+    Metropolis metropolis;
+    Annealer<PackedGrid<CellType>, CellSwap, PackedEnergy<Q>, GeometricSchedule> annealer(grid, &bestGrid, energy, schedule, rng, metropolis);
+    annealer.currentScore = annealer.bestScore = energy.score(grid);
+    annealer.bestInterval = grid.size();
+    annealer.run();
+
+    if (annealer.currentScore < annealer.bestScore)
+    {
+        grid = bestGrid;
+    }
+    return annealer.iteration;
+}
+
+// Annealer hooks of a tempering sweep, counting the accepted moves
+struct AcceptanceCount : NoAnnealHooks
+{
+    long long accepted = 0;
+
+    template <class A>
+    void afterStep(A &, bool wasAccepted, double) { accepted += wasAccepted; }
+};
+
+// Settings for parallel tempering (replica exchange)
+struct TemperingOptions
+{
+    int replicas = 0;             // Number of replicas and threads, 0 = one per hardware thread
+    double minTemperature = 0.1;  // Coldest rung of the geometric temperature ladder
+    double maxTemperature = 50.0; // Hottest rung of the ladder
+    int sweepLength = 1000;       // Metropolis steps per replica between exchange rounds
+    int exchangeRounds = 200;     // Number of exchange rounds
+};
+
+// Outcome of a parallel tempering run
+struct TemperingResult
+{
+    Grid<CellType> bestGrid;
+    double bestScore = 0.0;
+    vector<double> temperatures;    // Temperature ladder, coldest first
+    vector<double> acceptanceRates; // Metropolis acceptance rate per rung
+    vector<double> exchangeRates;   // Exchange acceptance rate between rung s and s + 1
+};
+
+// Barrier for a fixed number of threads that spins instead of blocking. The
+// last thread to arrive runs the completion step before releasing the others,
+// so the completion step sees every thread's work and runs exactly once.
+class SpinBarrier
+{
+public:
+    explicit SpinBarrier(int threads) : threads_(threads) {}
+
+    template <typename Completion>
+    void arrive(Completion completion)
+    {
+        const int generation = generation_.load(memory_order_acquire);
+        if (arrived_.fetch_add(1, memory_order_acq_rel) == threads_ - 1)
+        {
+            completion();
+            arrived_.store(0, memory_order_relaxed);
+            generation_.store(generation + 1, memory_order_release);
+        }
+        else
+        {
+            while (generation_.load(memory_order_acquire) == generation)
+            {
+                this_thread::yield();
+            }
         }
-        cout << endl;
     }
-}
 
-// Function to compute distance maps for each land use type
-map<CellType, vector<vector<double>>> computeDistanceMaps(const vector<vector<CellType>> &grid)
+private:
+    const int threads_;
+    atomic<int> arrived_{0};
+    atomic<int> generation_{0};
+};
+
+// Parallel tempering: replicas of the grid run Metropolis sweeps at a fixed
+// geometric ladder of temperatures, one thread each, sharing the read-only
+// utility table. After each sweep neighbouring rungs exchange temperatures
+// with probability min(1, exp((S_hot - S_cold) * (1/T_cold - 1/T_hot))).
+// Exchanges swap rung assignments rather than grids, so they cost O(1).
+// Every replica and the exchange step have their own Rng stream, so a run is
+// reproducible from its seed regardless of thread scheduling.
+TemperingResult parallelTempering(
+    const Grid<CellType> &grid,
+    const UtilityTable &utility,
+    uint64_t seed,
+    const TemperingOptions &options = TemperingOptions())
 {
-    map<CellType, vector<vector<double>>> distanceMaps;
+    int numReplicas = options.replicas > 0 ? options.replicas : static_cast<int>(thread::hardware_concurrency());
+    numReplicas = max(numReplicas, 1);
 
-    for (CellType landUseType : landUseTypes)
+    TemperingResult result;
+    result.bestGrid = grid;
+    result.bestScore = calculateScore(grid, utility);
+
+    // Geometric temperature ladder, coldest first
+    for (int s = 0; s < numReplicas; ++s)
+    {
+        double fraction = numReplicas > 1 ? static_cast<double>(s) / (numReplicas - 1) : 0.0;
+        result.temperatures.push_back(options.minTemperature * pow(options.maxTemperature / options.minTemperature, fraction));
+    }
+
+    const vector<int> agentCells = collectAgentCells(grid);
+    if (!hasMixedAgents(grid, agentCells))
+    {
+        result.acceptanceRates.assign(numReplicas, 0.0);
+        result.exchangeRates.assign(max(numReplicas - 1, 0), 0.0);
+        return result; // Every swap would leave the grid unchanged
+    }
+
+    struct Replica
+    {
+        Grid<CellType> grid;
+        double score;
+        Grid<CellType> bestGrid;
+        double bestScore;
+        Rng rng;
+        Metropolis metropolis;
+    };
+
+    vector<Replica> replicas;
+    for (int r = 0; r < numReplicas; ++r)
+    {
+        replicas.push_back({grid, result.bestScore, grid, result.bestScore, Rng::stream(seed, r + 1), Metropolis()});
+    }
+
+    // Rung assignments and statistics. These are only written by each replica's
+    // own thread between barriers, or by the completion step inside a barrier.
+    vector<int> rungOfReplica(numReplicas), replicaOfRung(numReplicas);
+    for (int r = 0; r < numReplicas; ++r)
+    {
+        rungOfReplica[r] = replicaOfRung[r] = r;
+    }
+    vector<long long> accepted(numReplicas, 0);
+    vector<long long> exchangeAttempts(max(numReplicas - 1, 0), 0), exchangeAccepts(max(numReplicas - 1, 0), 0);
+    vector<long long> acceptedByReplica(numReplicas, 0);
+
+    Rng exchangeRng = Rng::stream(seed, 0);
+    SpinBarrier barrier(numReplicas);
+    const LandUseEnergy energy = {utility, agentCells};
+
+    auto exchange = [&](int round)
     {
-        vector<vector<double>> distanceMap(ROWS, vector<double>(COLS, numeric_limits<double>::max()));
-        queue<pair<int, int>> q;
+        for (int r = 0; r < numReplicas; ++r)
+        {
+            accepted[rungOfReplica[r]] += acceptedByReplica[r];
+            acceptedByReplica[r] = 0;
+        }
 
-        // Initialize the queue with positions of the land use type
-        for (int i = 0; i < ROWS; ++i)
+        // Alternate between even and odd neighbouring pairs
+        for (int s = round % 2; s + 1 < numReplicas; s += 2)
         {
-            for (int j = 0; j < COLS; ++j)
+            Replica &cold = replicas[replicaOfRung[s]];
+            Replica &hot = replicas[replicaOfRung[s + 1]];
+            double exponent = (hot.score - cold.score) * (1.0 / result.temperatures[s] - 1.0 / result.temperatures[s + 1]);
+
+            exchangeAttempts[s]++;
+            if (exponent >= 0.0 || exp(exponent) > exchangeRng.uniform01())
             {
-                if (grid[i][j] == landUseType)
-                {
-                    distanceMap[i][j] = 0.0;
-                    q.emplace(i, j);
-                }
+                exchangeAccepts[s]++;
+                swap(replicaOfRung[s], replicaOfRung[s + 1]);
+                rungOfReplica[replicaOfRung[s]] = s;
+                rungOfReplica[replicaOfRung[s + 1]] = s + 1;
             }
         }
+    };
 
-        // BFS to compute distances
-        while (!q.empty())
+    auto worker = [&](int r)
+    {
+        Replica &replica = replicas[r];
+        for (int round = 0; round < options.exchangeRounds; ++round)
         {
-            int x = q.front().first;
-            int y = q.front().second;
-            q.pop();
-
-            static const int dx[] = {-1, 0, 1, 0};
-            static const int dy[] = {0, 1, 0, -1};
+            ConstantSchedule sweep(result.temperatures[rungOfReplica[r]], options.sweepLength);
+            Annealer<Grid<CellType>, CellSwap, LandUseEnergy, ConstantSchedule> annealer(replica.grid, &replica.bestGrid, energy, sweep, replica.rng, replica.metropolis);
+            annealer.currentScore = replica.score;
+            annealer.bestScore = replica.bestScore;
+            AcceptanceCount hooks;
+            annealer.run(hooks);
+            replica.score = annealer.currentScore;
+            replica.bestScore = annealer.bestScore;
+            acceptedByReplica[r] += hooks.accepted;
+            barrier.arrive([&] { exchange(round); });
+        }
+    };
 
-            for (int dir = 0; dir < 4; ++dir)
-            {
-                int nx = x + dx[dir];
-                int ny = y + dy[dir];
+    vector<thread> threads;
+    for (int r = 1; r < numReplicas; ++r)
+    {
+        threads.emplace_back(worker, r);
+    }
+    worker(0);
+    for (thread &t : threads)
+    {
+        t.join();
+    }
 
-                if (nx >= 0 && nx < ROWS && ny >= 0 && ny < COLS)
-                {
-                    if (distanceMap[nx][ny] > distanceMap[x][y] + 1.0)
-                    {
-                        distanceMap[nx][ny] = distanceMap[x][y] + 1.0;
-                        q.emplace(nx, ny);
-                    }
-                }
-            }
+    // Reduce to the global best over all replicas
+    for (const Replica &replica : replicas)
+    {
+        if (replica.bestScore > result.bestScore)
+        {
+            result.bestScore = replica.bestScore;
+            result.bestGrid = replica.bestGrid;
         }
+    }
 
-        distanceMaps[landUseType] = distanceMap;
+    for (int s = 0; s < numReplicas; ++s)
+    {
+        double steps = static_cast<double>(options.exchangeRounds) * options.sweepLength;
+        result.acceptanceRates.push_back(steps > 0 ? accepted[s] / steps : 0.0);
+    }
+    for (int s = 0; s + 1 < numReplicas; ++s)
+    {
+        result.exchangeRates.push_back(exchangeAttempts[s] > 0 ? static_cast<double>(exchangeAccepts[s]) / exchangeAttempts[s] : 0.0);
     }
 
-    return distanceMaps;
+    return result;
 }
 
-// Function to calculate total score based on distances to land use types
-double calculateScore(const vector<vector<CellType>> &grid, const map<CellType, vector<vector<double>>> &distanceMaps)
+// Forward declarations of the grid generators used to initialise chains
+void generateGrid_input(Grid<CellType> &grid, map<CellType, double> agentPercentages, Rng &rng);
+void generateGrid_heuristic(Grid<CellType> &grid, map<CellType, double> agentPercentages, const UtilityTable &utility, Rng &rng);
+
+// Settings for multi-start optimisation
+struct MultiStartOptions
 {
-    double totalScore = 0.0;
+    int chains = 0;  // Number of independent chains, 0 = one per thread
+    int threads = 0; // Size of the thread pool, 0 = one per hardware thread
+    double temperature = 1000.0;
+    double cooldown = 1.0;
+    double coolingRate = 0.003;
+    double cancelAfter = 0.75;  // Schedule fraction after which lagging chains may be cancelled
+    double cancelMargin = 0.1;  // Cancel when more than this fraction of |leader| behind the leader
+};
+
+// Per-chain statistics of a multi-start run
+struct ChainStats
+{
+    int chain = 0;
+    bool heuristicStart = false; // Initialised with generateGrid_heuristic rather than generateGrid_input
+    double initialScore = 0.0;
+    double bestScore = 0.0;
+    int64_t iterations = 0;
+    bool cancelled = false;
+    long long milliseconds = 0;
+};
+
+// Outcome of a multi-start run
+struct MultiStartResult
+{
+    Grid<CellType> bestGrid;
+    double bestScore = 0.0;
+    int bestChain = -1;
+    vector<ChainStats> chains;
+};
+
+// Observer publishing a chain's best score to the shared leader score and
+// cancelling the chain once it falls too far behind the leader
+class ChainObserver : public AnnealObserver
+{
+public:
+    ChainObserver(atomic<double> &leader, const MultiStartOptions &options) : leader(leader), options(options) {}
 
-    // Calculate score for each agent cell
-    for (int i = 0; i < ROWS; ++i)
+    bool onProgress(const AnnealProgress &progress) override
     {
-        for (int j = 0; j < COLS; ++j)
+        double current = leader.load(memory_order_relaxed);
+        while (progress.bestScore > current && !leader.compare_exchange_weak(current, progress.bestScore, memory_order_relaxed))
         {
-            CellType agentCell = grid[i][j];
-            if (find(agentTypes.begin(), agentTypes.end(), agentCell) == agentTypes.end())
-            {
-                continue; // Not an agent cell
-            }
+        }
 
-            const vector<float> &preferences = agentPreferences[agentCell];
-            double agentScore = 0.0;
+        double leaderScore = max(current, progress.bestScore);
+        if (progress.progress >= options.cancelAfter &&
+            progress.bestScore < leaderScore - options.cancelMargin * fabs(leaderScore))
+        {
+            cancelled = true;
+            return false;
+        }
+        return true;
+    }
 
-            // For each land use type
-            for (size_t k = 0; k < landUseTypes.size(); ++k)
-            {
-                CellType landUseType = landUseTypes[k];
-                float preference = preferences[k];
+    bool cancelled = false;
 
-                double distance = distanceMaps.at(landUseType)[i][j];
+private:
+    atomic<double> &leader;
+    const MultiStartOptions &options;
+};
 
-                // Avoid division by zero and check if distance is finite
-                if (distance > 0.0 && distance < numeric_limits<double>::max())
-                {
-                    agentScore += preference / distance;
-                }
-            }
+// Multi-start optimisation: runs independent optimiseGrid chains from a mix of
+// generateGrid_input and generateGrid_heuristic initialisations on a thread
+// pool. Chains share only the leader score, which is used to cancel chains
+// that fall far behind after options.cancelAfter of the schedule. Chain c uses
+// Rng stream c + 1 of the seed, so results do not depend on scheduling except
+// through cancellation.
+MultiStartResult multiStartOptimise(
+    const Grid<CellType> &siteGrid,
+    const map<CellType, double> &agentPercentages,
+    const UtilityTable &utility,
+    uint64_t seed,
+    const MultiStartOptions &options = MultiStartOptions())
+{
+    int numThreads = options.threads > 0 ? options.threads : static_cast<int>(thread::hardware_concurrency());
+    numThreads = max(numThreads, 1);
+    const int numChains = options.chains > 0 ? options.chains : numThreads;
+    numThreads = min(numThreads, numChains);
 
-            totalScore += agentScore;
+    vector<Grid<CellType>> bestGrids(numChains);
+    vector<ChainStats> stats(numChains);
+    atomic<double> leader(-numeric_limits<double>::max());
+    atomic<int> nextChain(0);
+
+    auto worker = [&]()
+    {
+        for (int c = nextChain.fetch_add(1); c < numChains; c = nextChain.fetch_add(1))
+        {
+            auto chainStart = high_resolution_clock::now();
+            Rng rng = Rng::stream(seed, c + 1);
+            ChainStats &chain = stats[c];
+            chain.chain = c;
+            chain.heuristicStart = (c % 2 == 1);
+
+            Grid<CellType> grid = siteGrid;
+            if (chain.heuristicStart)
+                generateGrid_heuristic(grid, agentPercentages, utility, rng);
+            else
+                generateGrid_input(grid, agentPercentages, rng);
+            chain.initialScore = calculateScore(grid, utility);
+
+            ChainObserver observer(leader, options);
+            chain.iterations = optimiseGrid(grid, utility, rng, options.temperature, options.cooldown, options.coolingRate, 0, &observer);
+            chain.bestScore = calculateScore(grid, utility);
+            chain.cancelled = observer.cancelled;
+            observer.onProgress({chain.iterations, 0.0, 0.0, chain.bestScore, chain.bestScore}); // Publish the final best
+            chain.milliseconds = duration_cast<milliseconds>(high_resolution_clock::now() - chainStart).count();
+
+            bestGrids[c] = move(grid);
         }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < numThreads; ++t)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread &t : threads)
+    {
+        t.join();
     }
 
-    return totalScore;
+    // Best-of reduction over all chains
+    MultiStartResult result;
+    for (int c = 0; c < numChains; ++c)
+    {
+        if (result.bestChain < 0 || stats[c].bestScore > result.bestScore)
+        {
+            result.bestChain = c;
+            result.bestScore = stats[c].bestScore;
+        }
+    }
+    result.bestGrid = move(bestGrids[result.bestChain]);
+    result.chains = move(stats);
+    return result;
 }
 
-// Simulated Annealing Optimisation
-void optimiseGrid(
-    vector<vector<CellType>> &grid,
-    const map<CellType, vector<vector<double>>> &distanceMaps,
-    double _temperature = 1000.0,
-    double _cooldown = 1.0,
-    double _coolingRate = 0.003)
+// One what-if variant of a scenario sweep: agent percentages and preferences
+// on the common site. Preferences are indexed like landUseTypes.
+struct SweepScenario
 {
-    double temperature = _temperature;
-    double cooldown = _cooldown;
-    double coolingRate = _coolingRate;
-    double currentScore = calculateScore(grid, distanceMaps);
-    vector<vector<CellType>> bestGrid = grid;
-    double bestScore = currentScore;
+    string name;
+    map<CellType, double> agentPercentages;
+    map<CellType, vector<float>> preferences;
+};
 
-    int iteration = 0;
+// Settings for sweepScenarios
+struct SweepOptions
+{
+    int threads = 0;   // Size of the thread pool, 0 = one per hardware thread
+    int batchSize = 0; // Scenarios whose utility tables are held at once, 0 = 4 per thread
+
+    // Geometric schedule of each anneal. Runs start from the heuristic
+    // layout, so they start cool enough not to randomise it first.
+    double temperature = 5.0;
+    double cooldown = 0.01;
+    double coolingRate = 1e-5;
+    int rescoreInterval = 10000;
+};
 
-    auto optimisationStart = high_resolution_clock::now();
+// Outcome of one scenario of a sweep
+struct SweepResult
+{
+    string name;
+    double initialScore = 0.0;
+    double bestScore = 0.0;
+    int64_t iterations = 0;
+    double seconds = 0.0;
+    Grid<CellType> bestGrid;
+};
 
-    // Logging headers for performance analysis
-    LOG_PERF << "| Iteration | Temperature | Current Score | Best Score | Time (ms) |\n";
-    LOG_PERF << "|-----------|-------------|---------------|------------|-----------|\n";
+// Function to build the utility tables of scenarios [first, last) in one pass
+// over the distance fields. The inverse distances are computed once, then
+// every table row is a sum of preference-weighted inverse distance rows,
+// built block by block of cells so the inverse distances of a block stay in
+// cache across all scenarios. The blocks are shared out over `threads`.
+vector<UtilityTable> computeUtilityTables(const DistanceMaps &distanceMaps, const vector<SweepScenario> &scenarios, size_t first, size_t last, int threads)
+{
+    const int numCells = distanceMaps.rows * distanceMaps.cols;
+    const int types = distanceMaps.types;
 
-    while (temperature > cooldown)
+    // 1 / distance in cells, 0 where the utility formula skips the type
+    vector<double> inverse(static_cast<size_t>(types) * numCells, 0.0);
+    for (int k = 0; k < types; ++k)
     {
-        // Generate neighboring solution by swapping two random agent cells
-        vector<vector<CellType>> newGrid = grid;
-        int x1, y1, x2, y2;
-
-        // Find first agent cell to swap
-        do
+        for (int idx = 0; idx < numCells; ++idx)
         {
-            x1 = rand() % ROWS;
-            y1 = rand() % COLS;
-        } while (find(agentTypes.begin(), agentTypes.end(), grid[x1][y1]) == agentTypes.end());
+            const uint16_t distance = distanceMaps.at(k, idx);
+            if (distance > 0 && distance != UNREACHABLE_DISTANCE)
+                inverse[static_cast<size_t>(k) * numCells + idx] = 1.0 / (distance * distanceMaps.units[k]);
+        }
+    }
 
-        // Find second agent cell to swap
-        do
-        {
-            x2 = rand() % ROWS;
-            y2 = rand() % COLS;
-        } while (find(agentTypes.begin(), agentTypes.end(), grid[x2][y2]) == agentTypes.end());
+    vector<UtilityTable> tables(last - first);
+    for (UtilityTable &utility : tables)
+    {
+        utility.rows = distanceMaps.rows;
+        utility.cols = distanceMaps.cols;
+        utility.values.assign(static_cast<size_t>(NUM_CELL_TYPES) * numCells, 0.0);
+        for (CellType agentType : agentTypes)
+            utility.activeTypes |= 1u << agentType;
+    }
 
-        // Swap the agent cells
-        swap(newGrid[x1][y1], newGrid[x2][y2]);
+    const int blockSize = 2048;
+    const int numBlocks = (numCells + blockSize - 1) / blockSize;
+    parallelFor(numBlocks, threads, [&](int block)
+                {
+                    const int begin = block * blockSize;
+                    const int end = min(begin + blockSize, numCells);
+                    for (size_t s = first; s < last; ++s)
+                    {
+                        for (CellType agentType : agentTypes)
+                        {
+                            const vector<float> &preferences = scenarios[s].preferences.at(agentType);
+                            double *row = &tables[s - first].values[static_cast<size_t>(agentType) * numCells];
+                            for (int k = 0; k < types; ++k)
+                            {
+                                const double preference = preferences[k];
+                                const double *inverseRow = &inverse[static_cast<size_t>(k) * numCells];
+                                for (int idx = begin; idx < end; ++idx)
+                                    row[idx] += preference * inverseRow[idx];
+                            }
+                        }
+                    }
+                });
+    return tables;
+}
 
-        double newScore = calculateScore(newGrid, distanceMaps);
-        double deltaScore = newScore - currentScore;
+// Scenario sweep: runs every scenario on the same site, sharing the distance
+// maps and amortising setup over the whole batch. Utility tables are built
+// a batch at a time with computeUtilityTables, and the scenario runs
+// (heuristic initialisation and a full anneal) are scheduled on a
+// work-stealing pool. Scenario s uses Rng stream s + 1 of the seed, so
+// results do not depend on the number of threads or the batch size.
+vector<SweepResult> sweepScenarios(
+    const Grid<CellType> &siteGrid,
+    const vector<SweepScenario> &scenarios,
+    uint64_t seed,
+    const SweepOptions &options = SweepOptions())
+{
+    int numThreads = options.threads > 0 ? options.threads : static_cast<int>(thread::hardware_concurrency());
+    numThreads = max(numThreads, 1);
+    const size_t batchSize = options.batchSize > 0 ? options.batchSize : 4 * numThreads;
 
-        /*
-        The probability of accepting a new configuration is determined by the Metropolis criterion:
+    const DistanceMaps distanceMaps = computeDistanceMaps(siteGrid);
+    vector<SweepResult> results(scenarios.size());
 
-        𝑃 = 𝑒^(Δ𝑆/𝑇)
+    for (size_t first = 0; first < scenarios.size(); first += batchSize)
+    {
+        const size_t last = min(first + batchSize, scenarios.size());
+        const vector<UtilityTable> tables = computeUtilityTables(distanceMaps, scenarios, first, last, numThreads);
 
-        ΔS: Change in score (new score minus current score).
+        parallelFor(static_cast<int>(last - first), numThreads, [&](int b)
+                    {
+                        const auto start = steady_clock::now();
+                        const size_t s = first + b;
+                        const UtilityTable &utility = tables[b];
+                        Rng rng = Rng::stream(seed, s + 1);
+
+                        SweepResult &result = results[s];
+                        result.name = scenarios[s].name;
+                        result.bestGrid = siteGrid;
+                        generateGrid_heuristic(result.bestGrid, scenarios[s].agentPercentages, utility, rng);
+                        result.initialScore = calculateScore(result.bestGrid, utility);
+                        result.iterations = optimiseGrid(result.bestGrid, utility, rng, options.temperature, options.cooldown,
+                                                         options.coolingRate, options.rescoreInterval);
+                        result.bestScore = calculateScore(result.bestGrid, utility);
+                        result.seconds = duration<double>(steady_clock::now() - start).count();
+                    });
+    }
+    return results;
+}
 
-        Positive ΔS: The new configuration is better and is always accepted.
-        Negative ΔS: The new configuration is worse; acceptance depends on the temperature.
-        T: Current temperature.
-        */
-        if (deltaScore > 0 || exp(deltaScore / temperature) > ((double)rand() / RAND_MAX))
+// Function to quote a string as a JSON string literal
+string jsonString(const string &text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
         {
-            grid = newGrid;
-            currentScore = newScore;
-
-            if (currentScore > bestScore)
-            {
-                bestGrid = grid;
-                bestScore = currentScore;
-            }
+            quoted += '\\';
+            quoted += c;
         }
-
-        // Logging for performance analysis every 100 iterations
-        if (iteration % 100 == 0)
+        else if (static_cast<unsigned char>(c) < 0x20)
         {
-            auto now = high_resolution_clock::now();
-            auto duration = duration_cast<milliseconds>(now - optimisationStart);
-            LOG_PERF << "| " << setw(9) << iteration
-                     << " | " << setw(11) << fixed << setprecision(2) << temperature
-                     << " | " << setw(13) << currentScore
-                     << " | " << setw(10) << bestScore
-                     << " | " << setw(9) << duration.count()
-                     << " |\n";
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+            quoted += escape;
         }
-
-        iteration++;
-        temperature *= 1 - coolingRate;
+        else
+            quoted += c;
     }
+    return quoted + "\"";
+}
 
-    grid = bestGrid;
+// Function to write sweep results as one JSON object of columns, one array
+// per field with an entry per scenario, e.g. for pandas.DataFrame. Numbers
+// are written with enough digits to read back exactly.
+void writeSweepResults(ostream &out, const vector<SweepResult> &results)
+{
+    const streamsize precision = out.precision(numeric_limits<double>::max_digits10);
+    auto column = [&](const char *name, auto value, bool last = false)
+    {
+        out << "  \"" << name << "\": [";
+        for (size_t s = 0; s < results.size(); ++s)
+            out << (s ? ", " : "") << value(results[s]);
+        out << (last ? "]\n" : "],\n");
+    };
+
+    out << "{\n";
+    column("scenario", [](const SweepResult &r) { return jsonString(r.name); });
+    column("initial_score", [](const SweepResult &r) { return r.initialScore; });
+    column("best_score", [](const SweepResult &r) { return r.bestScore; });
+    column("iterations", [](const SweepResult &r) { return r.iterations; });
+    column("seconds", [](const SweepResult &r) { return r.seconds; }, true);
+    out << "}\n";
+    out.precision(precision);
 }
 
 // Generate grid with random land use and agents based on percentages
-void generateGrid_random(vector<vector<CellType>> &grid, map<CellType, double> agentPercentages)
+void generateGrid_random(Grid<CellType> &grid, map<CellType, double> agentPercentages, Rng &rng)
 {
     // Initialize grid with EMPTY cells
-    for (int i = 0; i < ROWS; ++i)
-        for (int j = 0; j < COLS; ++j)
-            grid[i][j] = EMPTY;
+    grid.fill(EMPTY);
 
     // Set preset land use types (fixed cells)
-    int numLandUseCells = (ROWS * COLS) / 5; // Adjust as needed
+    int numLandUseCells = grid.size() / 5; // Adjust as needed
 
     for (CellType landUseType : landUseTypes)
     {
@@ -323,20 +2449,19 @@ void generateGrid_random(vector<vector<CellType>> &grid, map<CellType, double> a
             int x, y;
             do
             {
-                x = rand() % ROWS;
-                y = rand() % COLS;
-            } while (grid[x][y] != EMPTY);
-            grid[x][y] = landUseType;
+                x = rng.uniform(grid.rows());
+                y = rng.uniform(grid.cols());
+            } while (grid(x, y) != EMPTY);
+            grid.set(x, y, landUseType);
         }
     }
 
     // Calculate the number of each agent type to place
-    int totalCells = ROWS * COLS;
+    int totalCells = grid.size();
     int fixedCells = 0;
-    for (int i = 0; i < ROWS; ++i)
-        for (int j = 0; j < COLS; ++j)
-            if (grid[i][j] != EMPTY)
-                fixedCells++;
+    for (int idx = 0; idx < grid.size(); ++idx)
+        if (grid[idx] != EMPTY)
+            fixedCells++;
 
     int availableCells = totalCells - fixedCells;
     map<CellType, int> agentCounts;
@@ -353,40 +2478,34 @@ void generateGrid_random(vector<vector<CellType>> &grid, map<CellType, double> a
     }
 
     // Shuffle and assign to grid
-    random_shuffle(agentsToPlace.begin(), agentsToPlace.end());
+    shuffle(agentsToPlace.begin(), agentsToPlace.end(), rng);
     int index = 0;
-    for (int i = 0; i < ROWS && index < agentsToPlace.size(); ++i)
+    for (int idx = 0; idx < grid.size() && index < agentsToPlace.size(); ++idx)
     {
-        for (int j = 0; j < COLS && index < agentsToPlace.size(); ++j)
+        if (grid[idx] == EMPTY)
         {
-            if (grid[i][j] == EMPTY)
-            {
-                grid[i][j] = agentsToPlace[index++];
-            }
+            grid.set(idx, agentsToPlace[index++]);
         }
     }
 }
 
 // Generate grid based on input grid and assign agents to empty cells
-void generateGrid_input(vector<vector<CellType>> &grid, map<CellType, double> agentPercentages)
+void generateGrid_input(Grid<CellType> &grid, map<CellType, double> agentPercentages, Rng &rng)
 {
     // Count fixed cells
-    int totalCells = ROWS * COLS;
+    int totalCells = grid.size();
     int fixedCells = 0;
-    vector<pair<int, int>> emptyCells;
-    for (int i = 0; i < ROWS; ++i)
+    vector<int> emptyCells;
+    for (int idx = 0; idx < grid.size(); ++idx)
     {
-        for (int j = 0; j < COLS; ++j)
+        if (grid[idx] != EMPTY && find(landUseTypes.begin(), landUseTypes.end(), grid[idx]) == landUseTypes.end())
         {
-            if (grid[i][j] != EMPTY && find(landUseTypes.begin(), landUseTypes.end(), grid[i][j]) == landUseTypes.end())
-            {
-                // If cell is not empty and not a land use type, consider it fixed
-                fixedCells++;
-            }
-            else if (grid[i][j] == EMPTY)
-            {
-                emptyCells.emplace_back(i, j);
-            }
+            // If cell is not empty and not a land use type, consider it fixed
+            fixedCells++;
+        }
+        else if (grid[idx] == EMPTY)
+        {
+            emptyCells.push_back(idx);
         }
     }
 
@@ -407,137 +2526,424 @@ void generateGrid_input(vector<vector<CellType>> &grid, map<CellType, double> ag
     // In case of rounding errors, fill remaining cells with random agent types
     while (agentsToPlace.size() < availableCells)
     {
-        agentsToPlace.push_back(agentTypes[rand() % agentTypes.size()]);
+        agentsToPlace.push_back(agentTypes[rng.uniform(agentTypes.size())]);
     }
 
     // Shuffle and assign to grid
-    random_shuffle(agentsToPlace.begin(), agentsToPlace.end());
+    shuffle(agentsToPlace.begin(), agentsToPlace.end(), rng);
     int index = 0;
-    for (auto &cell : emptyCells)
+    for (int cell : emptyCells)
     {
-        grid[cell.first][cell.second] = agentsToPlace[index++];
+        grid.set(cell, agentsToPlace[index++]);
     }
 }
 
-// Generate grid with heuristic-based agent placement on input grid
-void generateGrid_heuristic(vector<vector<CellType>> &grid, map<CellType, double> agentPercentages, const map<CellType, vector<vector<double>>> &distanceMaps)
+// Generate grid with heuristic-based agent placement on input grid.
+//
+// Agent quotas are assigned with regret-greedy: each empty cell's regret is
+// the utility it loses if it does not get its best agent type (best minus
+// second best among types with quota left). Cells are placed in descending
+// regret order, so contested cells go first and indifferent ones last. The
+// order comes from a counting sort into regret buckets rather than a full
+// sort, and when a type's quota fills up only the cells that preferred it
+// are re-bucketed, so assignment is O(cells * agent types). Cells without a
+// preference (zero regret) are filled from the remaining quotas in
+// shuffled order.
+void generateGrid_heuristic(Grid<CellType> &grid, map<CellType, double> agentPercentages, const UtilityTable &utility, Rng &rng)
 {
     // Identify empty cells
-    vector<pair<int, int>> emptyCells;
-    for (int i = 0; i < ROWS; ++i)
-        for (int j = 0; j < COLS; ++j)
-            if (grid[i][j] == EMPTY)
-                emptyCells.emplace_back(i, j);
+    vector<int> emptyCells;
+    for (int idx = 0; idx < grid.size(); ++idx)
+    {
+        if (grid[idx] == EMPTY)
+            emptyCells.push_back(idx);
+    }
 
-    int availableCells = emptyCells.size();
+    const int availableCells = static_cast<int>(emptyCells.size());
+    const int numAgents = static_cast<int>(agentTypes.size());
+    if (availableCells == 0 || numAgents == 0)
+        return;
 
     // Calculate the number of each agent type to place
-    map<CellType, int> agentCounts;
+    vector<int> quota(numAgents);
     int totalAgents = 0;
-    for (CellType agentType : agentTypes)
+    for (int a = 0; a < numAgents; ++a)
     {
-        int count = static_cast<int>(agentPercentages[agentType] * availableCells);
-        agentCounts[agentType] = count;
-        totalAgents += count;
+        quota[a] = static_cast<int>(agentPercentages[agentTypes[a]] * availableCells);
+        totalAgents += quota[a];
     }
 
-    // Adjust for any rounding errors
+    // Adjust for any rounding errors by assigning remaining cells to random agent types
     while (totalAgents < availableCells)
     {
-        // Assign remaining cells to random agent types
-        CellType randomAgent = agentTypes[rand() % agentTypes.size()];
-        agentCounts[randomAgent]++;
+        quota[rng.uniform(numAgents)]++;
         totalAgents++;
     }
 
-    // For each agent type, calculate preference scores for all empty cells
-    map<CellType, vector<tuple<double, int, int>>> agentCellScores;
-    for (CellType agentType : agentTypes)
+    const size_t numCells = static_cast<size_t>(grid.size());
+    auto utilityOf = [&](int a, int cell)
     {
-        const vector<float> &preferences = agentPreferences[agentType];
-        vector<tuple<double, int, int>> cellScores; // (score, x, y)
+        return utility.values[static_cast<size_t>(agentTypes[a]) * numCells + cell];
+    };
 
-        for (const auto &cell : emptyCells)
+    // Best agent type with quota left for a cell, and its regret over the
+    // second best (0 if only one type is left)
+    auto bestChoice = [&](int cell, double &regret)
+    {
+        int best = -1;
+        bool hasSecond = false;
+        double first = 0.0, second = 0.0;
+        for (int a = 0; a < numAgents; ++a)
         {
-            int i = cell.first;
-            int j = cell.second;
-            double score = 0.0;
-
-            // Calculate preference score for this cell
-            for (size_t k = 0; k < landUseTypes.size(); ++k)
+            if (quota[a] == 0)
+                continue;
+            const double u = utilityOf(a, cell);
+            if (best < 0 || u > first)
             {
-                CellType landUseType = landUseTypes[k];
-                float preference = preferences[k];
-                double distance = distanceMaps.at(landUseType)[i][j];
-
-                if (distance > 0.0 && distance < numeric_limits<double>::max())
+                if (best >= 0)
                 {
-                    score += preference / distance;
+                    second = first;
+                    hasSecond = true;
                 }
+                first = u;
+                best = a;
+            }
+            else if (!hasSecond || u > second)
+            {
+                second = u;
+                hasSecond = true;
             }
+        }
+        regret = hasSecond ? first - second : 0.0;
+        return best;
+    };
+
+    vector<int> choice(availableCells);
+    vector<double> regret(availableCells);
+    double maxRegret = 0.0;
+    for (int e = 0; e < availableCells; ++e)
+    {
+        choice[e] = bestChoice(emptyCells[e], regret[e]);
+        maxRegret = max(maxRegret, regret[e]);
+    }
+
+    // Counting sort of the contested cells into regret buckets
+    const int numBuckets = max(1, min(4096, availableCells));
+    const double bucketScale = maxRegret > 0.0 ? (numBuckets - 1) / maxRegret : 0.0;
+    auto bucketOf = [&](double r)
+    {
+        return min(static_cast<int>(r * bucketScale), numBuckets - 1);
+    };
+
+    vector<int> bucketStart(numBuckets + 1, 0);
+    for (int e = 0; e < availableCells; ++e)
+    {
+        if (regret[e] > 0.0)
+            bucketStart[bucketOf(regret[e]) + 1]++;
+    }
+    for (int b = 0; b < numBuckets; ++b)
+    {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    vector<int> order(bucketStart[numBuckets]);
+    vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+    vector<int> indifferent; // Cells without a preference, placed last
+    for (int e = 0; e < availableCells; ++e)
+    {
+        if (regret[e] > 0.0)
+            order[fill[bucketOf(regret[e])]++] = e;
+        else
+            indifferent.push_back(e);
+    }
 
-            cellScores.emplace_back(-score, i, j); // Negative score for descending sort
+    // Cells re-bucketed after their preferred type filled up
+    vector<vector<int>> requeued(numBuckets);
+    vector<char> placed(availableCells, 0);
+
+    auto place = [&](int e, int a)
+    {
+        grid.set(emptyCells[e], agentTypes[a]);
+        placed[e] = 1;
+        quota[a]--;
+    };
+
+    // Place one contested cell, re-bucketing it if its choice is full.
+    // Returns false if it was deferred to a lower bucket.
+    auto visit = [&](int e, int bucket)
+    {
+        if (placed[e])
+            return true;
+        if (quota[choice[e]] == 0)
+        {
+            choice[e] = bestChoice(emptyCells[e], regret[e]);
+            if (regret[e] <= 0.0)
+            {
+                indifferent.push_back(e);
+                return false;
+            }
+            const int b = bucketOf(regret[e]);
+            if (b < bucket)
+            {
+                requeued[b].push_back(e);
+                return false;
+            }
         }
+        place(e, choice[e]);
+        return true;
+    };
 
-        // Sort cells based on scores (descending)
-        sort(cellScores.begin(), cellScores.end());
+    for (int b = numBuckets - 1; b >= 0; --b)
+    {
+        for (int k = bucketStart[b]; k < bucketStart[b + 1]; ++k)
+            visit(order[k], b);
+        for (size_t k = 0; k < requeued[b].size(); ++k)
+            visit(requeued[b][k], b);
+    }
 
-        agentCellScores[agentType] = cellScores;
+    // Fill the indifferent cells from the remaining quotas in shuffled order
+    vector<CellType> leftovers;
+    for (int a = 0; a < numAgents; ++a)
+    {
+        leftovers.insert(leftovers.end(), quota[a], agentTypes[a]);
+    }
+    shuffle(leftovers.begin(), leftovers.end(), rng);
+    size_t next = 0;
+    for (int e : indifferent)
+    {
+        if (!placed[e])
+        {
+            grid.set(emptyCells[e], leftovers[next++]);
+            placed[e] = 1;
+        }
     }
+}
 
-    // Assign agents to cells based on highest preference scores
-    vector<vector<bool>> occupied(ROWS, vector<bool>(COLS, false));
-    for (const auto &cell : emptyCells)
+// Settings of an OptimiserSession
+struct SessionOptions
+{
+    double coldTemperature = 10.0; // Start of the anneal when the session is created
+    double coldSeconds = 0.5;      // Wall time of that anneal
+    double warmTemperature = 0.5;  // Start of each re-anneal after an edit
+    double warmSeconds = 0.05;     // Wall time of each re-anneal
+    double cooldown = 0.01;        // Final temperature of both schedules
+    int rescoreInterval = 10000;
+};
+
+// Outcome of an OptimiserSession::optimise call
+struct SessionResult
+{
+    double score;
+    int64_t iterations;
+    double seconds;
+};
+
+// Long-running optimiser for interactive use: keeps the distance maps, the
+// utility table and the best layout found so far resident, takes edits of the
+// fixed cells, agent percentages and preferences, and re-anneals from the
+// previous layout with a short low-temperature deadline schedule instead of
+// starting cold. Edits of fixed cells patch the distance maps and utility
+// table incrementally (DynamicDistanceMaps); preference edits rebuild the
+// utility table, which does not touch the distance maps.
+//
+// Preferences are those of the runtime scenario (agentPreferences), so a
+// preference edit applies to everything in the process that reads them.
+class OptimiserSession
+{
+public:
+    // Start a session on a site whose EMPTY cells are free for agents: places
+    // the agents with the heuristic and runs one cold anneal
+    OptimiserSession(const Grid<CellType> &site, const map<CellType, double> &agentPercentages, uint64_t seed,
+                     const SessionOptions &options = SessionOptions())
+        : layout_(site), distances_(site), utility_(computeUtilityTable(distances_.maps())),
+          agentPercentages_(agentPercentages), rng_(seed), options_(options)
     {
-        occupied[cell.first][cell.second] = false;
+        generateGrid_heuristic(layout_, agentPercentages_, utility_, rng_);
+        anneal(options_.coldTemperature, options_.coldSeconds);
     }
 
-    for (CellType agentType : agentTypes)
+    const Grid<CellType> &layout() const { return layout_; }
+    const DistanceMaps &distanceMaps() const { return distances_.maps(); }
+    const UtilityTable &utility() const { return utility_; }
+    double score() const { return score_; }
+
+    // Function to change a fixed cell to a land use type, or to EMPTY to free
+    // it for agents. An agent on the cell is removed, and the agents are
+    // rebalanced to the percentages over the cells now available.
+    bool setFixedCell(int idx, CellType type, string &error)
+    {
+        if (idx < 0 || idx >= layout_.size())
+        {
+            error = "cell " + to_string(idx) + " is outside the site";
+            return false;
+        }
+        if (type != EMPTY && find(landUseTypes.begin(), landUseTypes.end(), type) == landUseTypes.end())
+        {
+            error = string(cellTypeNames[type]) + " is not a land use type";
+            return false;
+        }
+
+        const CellType previous = layout_[idx];
+        const vector<int> &changed = distances_.setCell(layout_, idx, type);
+        score_ += patchUtility(utility_, distances_.maps(), layout_, idx, previous, changed);
+        rebalanceAgents();
+        return true;
+    }
+
+    // Function to set the fraction of the available cells each agent type gets
+    bool setAgentPercentages(const map<CellType, double> &agentPercentages, string &error)
     {
-        int agentsToPlace = agentCounts[agentType];
-        vector<tuple<double, int, int>> &cellScores = agentCellScores[agentType];
-        int placedAgents = 0;
+        double total = 0.0;
+        for (const auto &entry : agentPercentages)
+        {
+            if (!isAgentType(entry.first) || entry.second < 0.0)
+            {
+                error = string("invalid share for ") + cellTypeNames[entry.first];
+                return false;
+            }
+            total += entry.second;
+        }
+        if (abs(total - 1.0) > 1e-6)
+        {
+            error = "agent percentages must sum to 1";
+            return false;
+        }
+
+        agentPercentages_ = agentPercentages;
+        rebalanceAgents();
+        return true;
+    }
 
-        for (const auto &entry : cellScores)
+    // Function to set the preference of an agent type towards a land use type
+    bool setPreference(CellType agentType, CellType landUseType, float preference, string &error)
+    {
+        const int k = distances_.maps().fieldIndex(landUseType);
+        if (!isAgentType(agentType) || k < 0)
         {
-            if (placedAgents >= agentsToPlace)
-                break;
+            error = string("no preference of ") + cellTypeNames[agentType] + " towards " + cellTypeNames[landUseType];
+            return false;
+        }
+
+        agentPreferences[agentType][k] = preference;
+        utility_ = computeUtilityTable(distances_.maps());
+        score_ = calculateScore(layout_, utility_);
+        return true;
+    }
+
+    // Function to re-anneal from the current layout after edits
+    SessionResult optimise() { return anneal(options_.warmTemperature, options_.warmSeconds); }
+    SessionResult optimise(double seconds) { return anneal(options_.warmTemperature, seconds); }
+
+private:
+    SessionResult anneal(double temperature, double seconds)
+    {
+        const auto start = steady_clock::now();
+        const int64_t iterations = optimiseWithSchedule(layout_, utility_, rng_, DeadlineSchedule(temperature, options_.cooldown, seconds), options_.rescoreInterval);
+        score_ = calculateScore(layout_, utility_);
+        return {score_, iterations, duration<double>(steady_clock::now() - start).count()};
+    }
 
-            double score = -get<0>(entry); // Original score
-            int i = get<1>(entry);
-            int j = get<2>(entry);
+    // Function to bring the agent counts back to the percentages after an
+    // edit: EMPTY cells and the lowest-utility cells of over-represented
+    // types are reassigned, each to the under-represented type with the
+    // highest utility there. The other agents keep their cells.
+    void rebalanceAgents()
+    {
+        const int numAgents = static_cast<int>(agentTypes.size());
+        vector<int> count(numAgents, 0);
+        vector<int> typeIndex(NUM_CELL_TYPES, -1);
+        for (int a = 0; a < numAgents; ++a)
+        {
+            typeIndex[agentTypes[a]] = a;
+        }
 
-            if (!occupied[i][j])
+        vector<int> pool; // Cells to reassign
+        vector<vector<int>> cellsOf(numAgents);
+        int available = 0;
+        for (int idx = 0; idx < layout_.size(); ++idx)
+        {
+            const int a = typeIndex[layout_[idx]];
+            if (a >= 0)
+            {
+                cellsOf[a].push_back(idx);
+                available++;
+            }
+            else if (layout_[idx] == EMPTY)
             {
-                grid[i][j] = agentType;
-                occupied[i][j] = true;
-                placedAgents++;
+                pool.push_back(idx);
+                available++;
             }
         }
 
-        // If not all agents placed (due to conflicts), assign randomly
-        while (placedAgents < agentsToPlace)
+        // Target counts: floor of each share, the remainder to the largest fractions
+        vector<int> deficit(numAgents);
+        vector<pair<double, int>> fractions;
+        int assigned = 0;
+        for (int a = 0; a < numAgents; ++a)
         {
-            int idx = rand() % emptyCells.size();
-            int i = emptyCells[idx].first;
-            int j = emptyCells[idx].second;
+            const double exact = agentPercentages_[agentTypes[a]] * available;
+            const int target = static_cast<int>(exact);
+            deficit[a] = target - static_cast<int>(cellsOf[a].size());
+            fractions.emplace_back(exact - target, a);
+            assigned += target;
+        }
+        sort(fractions.rbegin(), fractions.rend());
+        for (int r = 0; assigned < available && numAgents > 0; ++r, ++assigned)
+        {
+            deficit[fractions[r % numAgents].second]++;
+        }
+
+        // Release the lowest-utility cells of every over-represented type
+        for (int a = 0; a < numAgents; ++a)
+        {
+            if (deficit[a] >= 0)
+                continue;
+            vector<int> &cells = cellsOf[a];
+            const int surplus = -deficit[a];
+            nth_element(cells.begin(), cells.begin() + (surplus - 1), cells.end(), [&](int x, int y) {
+                return utility_.at(agentTypes[a], x) < utility_.at(agentTypes[a], y);
+            });
+            pool.insert(pool.end(), cells.begin(), cells.begin() + surplus);
+            deficit[a] = 0;
+        }
 
-            if (!occupied[i][j])
+        for (int idx : pool)
+        {
+            int best = -1;
+            for (int a = 0; a < numAgents; ++a)
             {
-                grid[i][j] = agentType;
-                occupied[i][j] = true;
-                placedAgents++;
+                if (deficit[a] > 0 && (best < 0 || utility_.at(agentTypes[a], idx) > utility_.at(agentTypes[best], idx)))
+                    best = a;
             }
+            if (best < 0)
+                break;
+            score_ += utility_.at(agentTypes[best], idx) - utility_.at(layout_[idx], idx);
+            layout_.set(idx, agentTypes[best]);
+            deficit[best]--;
         }
     }
-}
 
-int main()
+    Grid<CellType> layout_;
+    DynamicDistanceMaps distances_;
+    UtilityTable utility_;
+    map<CellType, double> agentPercentages_;
+    Rng rng_;
+    SessionOptions options_;
+    double score_ = 0.0;
+};
+
+// Programs that reuse the optimiser (e.g. Benchmark_landuse.cpp) define
+// LANDUSE_NO_MAIN and include this file for everything above
+#ifndef LANDUSE_NO_MAIN
+
+int main(int argc, char *argv[])
 {
-    srand(static_cast<unsigned int>(time(0)));
+    // Pass a seed as the first argument to reproduce a run
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : static_cast<uint64_t>(time(0));
+    Rng rng(seed);
+    cout << "Seed: " << seed << endl;
 
-    // Initialize grid
-    vector<vector<CellType>> grid(ROWS, vector<CellType>(COLS, EMPTY));
+    // Initialize grid (dimensions are a runtime property of the grid)
+    Grid<CellType> grid(12, 12, EMPTY);
 
     // Agent percentages (must sum to 1.0)
     map<CellType, double> agentPercentages = {
@@ -550,21 +2956,19 @@ int main()
     // Uncomment one of the following:
 
     // Method 1: Generate random grid
-    // generateGrid_random(grid, agentPercentages);
+    // generateGrid_random(grid, agentPercentages, rng);
 
     // Method 2: Generate grid based on input
     // For demonstration, let's define an input grid with some land use types
     /*
     // Define input grid with some land use types
-    for (int i = 0; i < ROWS; ++i)
-        for (int j = 0; j < COLS; ++j)
-            grid[i][j] = EMPTY;
+    grid.fill(EMPTY);
 
     // Set some land use types in specific positions
-    grid[0][0] = TRANSPORT;
-    grid[5][5] = PUBLIC;
-    grid[10][10] = LANDSCAPE;
-    grid[15][15] = ROAD;
+    grid.set(0, 0, TRANSPORT);
+    grid.set(5, 5, PUBLIC);
+    grid.set(10, 10, LANDSCAPE);
+    grid.set(15, 15, ROAD);
     */
 
     grid = {
@@ -581,45 +2985,149 @@ int main()
         {EMPTY, EMPTY, EMPTY, TRANSPORT, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, TRANSPORT, EMPTY, EMPTY},
         {EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, PUBLIC, PUBLIC, PUBLIC, EMPTY, EMPTY, EMPTY, EMPTY}};
 
-    // Compute distance maps
-    auto distanceStart = high_resolution_clock::now();
-    map<CellType, vector<vector<double>>> distanceMaps = computeDistanceMaps(grid);
-    auto distanceEnd = high_resolution_clock::now();
-    auto distanceDuration = duration_cast<milliseconds>(distanceEnd - distanceStart);
-    cout << "Distance Maps Computation Time: " << distanceDuration.count() << " milliseconds" << endl;
-
-    auto initialScoreStart = high_resolution_clock::now();
-    double initialScore = calculateScore(grid, distanceMaps);
-    auto initialScoreEnd = high_resolution_clock::now();
-    auto initialScoreDuration = duration_cast<milliseconds>(initialScoreEnd - initialScoreStart);
+    // Method 3: Load a site file given as the third argument, replacing the grid
+    // above. The cells are memory-mapped, not parsed. A .csv export is first
+    // converted once to <path>.site with the current scenario.
+    SiteFile siteFile;
+    const bool loadedSite = argc > 3;
+    if (loadedSite)
+    {
+        string sitePath = argv[3];
+        string error;
+        if (sitePath.size() > 4 && sitePath.compare(sitePath.size() - 4, 4, ".csv") == 0)
+        {
+            const string csvPath = sitePath;
+            sitePath += ".site";
+            if (!importSiteCsv(csvPath, sitePath, siteDescription(), error))
+            {
+                cerr << "Import failed: " << error << endl;
+                return 1;
+            }
+        }
+        if (!siteFile.open(sitePath, error) || !loadSite(siteFile, grid, error))
+        {
+            cerr << "Cannot load site: " << error << endl;
+            return 1;
+        }
+        cout << "Loaded " << grid.rows() << "x" << grid.cols() << " site from " << sitePath << endl;
+    }
+
+    OptimiserMetrics metrics;
+    metrics.sampleInterval = 100;
+
+    // Compute distance maps. Other backends can be selected through DistanceOptions,
+    // e.g. options.metric = EUCLIDEAN for straight-line or WEIGHTED for walking distances.
+    METRICS_BEGIN(&metrics, PHASE_DISTANCE_MAPS);
+    DistanceMaps distanceMaps = computeDistanceMaps(grid);
+    METRICS_END(&metrics, PHASE_DISTANCE_MAPS);
+
+    // Precompute the utility of each agent type at each cell
+    METRICS_BEGIN(&metrics, PHASE_UTILITY);
+    // (the compile-time scenario unless a site file brought its own preferences)
+    UtilityTable utility = loadedSite ? computeUtilityTable(distanceMaps) : computeUtilityTable<StandardScenario>(distanceMaps);
+    // Alternative: gravity model, accessibility summed over all land use cells
+    // with a distance decay kernel instead of the nearest cell of each type
+    // UtilityTable utility = computeUtilityTable(computeAccessibilityFields(grid));
+    METRICS_END(&metrics, PHASE_UTILITY);
+
+    double initialScore = calculateScore(grid, utility);
     cout << "Initial Score: " << initialScore << endl;
-    cout << "Initial Score Computation Time: " << initialScoreDuration.count() << " milliseconds" << endl;
 
-    generateGrid_input(grid, agentPercentages);
-    //generateGrid_heuristic(grid, agentPercentages, distanceMaps);
+    // Keep the site with only its fixed land use cells for alternative initialisations
+    const Grid<CellType> siteGrid = grid;
+
+    METRICS_BEGIN(&metrics, PHASE_INIT);
+    generateGrid_input(grid, agentPercentages, rng);
+    //generateGrid_heuristic(grid, agentPercentages, utility, rng);
+    METRICS_END(&metrics, PHASE_INIT);
     cout << "Initial Grid:" << endl;
     printGrid(grid);
 
-    auto optimisationStart = high_resolution_clock::now();
+    // A checkpoint path as the fourth argument makes the run restartable: the
+    // state is saved there every 1000 iterations, and if the file exists the
+    // run continues from it with the same result as an uninterrupted run. The
+    // file is removed once the run completes.
+    if (argc > 4)
+    {
+        const string checkpointPath = argv[4];
+        CheckpointWriter<CellType> checkpoints(checkpointPath, 1000);
+        string error;
+        if (ifstream(checkpointPath).good())
+        {
+            if (resumeOptimisation(checkpointPath, grid, utility, rng, error, nullptr, &metrics, &checkpoints) < 0)
+            {
+                cerr << "Cannot resume: " << error << endl;
+                return 1;
+            }
+            cout << "Resumed from " << checkpointPath << endl;
+        }
+        else
+        {
+            optimiseGrid(grid, utility, rng, 1000, 0.1, 0.001, 1000, nullptr, &metrics, &checkpoints);
+        }
+
+        // The run completed, so the checkpoint is no longer needed
+        checkpoints.flush();
+        remove(checkpointPath.c_str());
+    }
+    else
+    {
+        optimiseGrid(grid, utility, rng, 1000, 0.1, 0.001, 1000, nullptr, &metrics);
+    }
+
+    // Alternative: other cooling schedules, e.g. finish within 100 ms, or steer
+    // the acceptance ratio and reheat when the best score stalls
+    // optimiseWithSchedule(grid, utility, rng, DeadlineSchedule(1000, 0.1, 0.1), 1000, nullptr, &metrics);
+    // optimiseWithSchedule(grid, utility, rng, Reheating<AdaptiveSchedule>(AdaptiveSchedule(1000, 10000)), 1000);
 
-    optimiseGrid(grid, distanceMaps, 1000, 0.1, 0.001);
+    // Alternative: parallel tempering with one replica per hardware thread
+    // TemperingResult tempering = parallelTempering(grid, utility, seed);
+    // grid = tempering.bestGrid;
 
-    auto optimisationEnd = high_resolution_clock::now();
-    auto optimisationDuration = duration_cast<milliseconds>(optimisationEnd - optimisationStart);
+    // Alternative: independent chains from mixed initialisations, best of all
+    // MultiStartResult multiStart = multiStartOptimise(siteGrid, agentPercentages, utility, seed);
+    // grid = multiStart.bestGrid;
 
     cout << "\nOptimised Grid:" << endl;
     printGrid(grid);
 
-    auto finalScoreStart = high_resolution_clock::now();
-    double finalScore = calculateScore(grid, distanceMaps);
-    auto finalScoreEnd = high_resolution_clock::now();
-    auto finalScoreDuration = duration_cast<milliseconds>(finalScoreEnd - finalScoreStart);
+    double finalScore = calculateScore(grid, utility);
     cout << "Optimised Score: " << finalScore << endl;
-    cout << "Optimised Score Computation Time: " << finalScoreDuration.count() << " milliseconds" << endl;
 
-    cout << "Optimisation Time: " << optimisationDuration.count() << " milliseconds" << endl;
+    cout << "\nProposals: " << metrics.proposals
+         << ", accepted uphill: " << metrics.acceptedUphill
+         << ", accepted downhill: " << metrics.acceptedDownhill
+         << ", evaluations/s: " << fixed << setprecision(0) << metrics.evaluationsPerSecond() << defaultfloat << endl;
+    for (int p = 0; p < NUM_PHASES; ++p)
+    {
+        cout << "Phase " << phaseName(static_cast<MetricsPhase>(p)) << ": "
+             << fixed << setprecision(3) << metrics.phaseSeconds[p] * 1000.0 << defaultfloat << " ms" << endl;
+    }
+
+    // Memory held by the structures of the run, to size jobs for larger sites
+    // (PackedGrid and QuantisedUtilityTable shrink the grid and the table)
+    MemoryReport memory;
+    memory.add("grid", grid.memoryBytes());
+    memory.add("distance_maps", distanceMaps.memoryBytes());
+    memory.add("utility_table", utility.memoryBytes());
+    cout << "\nMemory:" << endl;
+    memory.write(cout);
+
+    // Optional machine-readable export: second argument is the metrics file,
+    // CSV trace if it ends in .csv, full JSON report otherwise
+    if (argc > 2)
+    {
+        const string path = argv[2];
+        ofstream out(path);
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0)
+            metrics.writeCsv(out);
+        else
+            metrics.writeJson(out);
+    }
 
     return 0;
 }
 
+#endif // LANDUSE_NO_MAIN
+
 #endif
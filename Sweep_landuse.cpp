@@ -0,0 +1,212 @@
+/*
+ * Batch scenario sweep for the land use optimiser.
+ *
+ * Runs many what-if variants of the agent percentages and preferences on one
+ * site in a single process: the distance maps are computed once, the
+ * utility tables are built a batch at a time in one pass, and the anneals
+ * are spread over a work-stealing thread pool (see sweepScenarios).
+ *
+ * The scenario file is a CSV table with a header row and one scenario per
+ * row. The first column is the scenario name; the other columns are named
+ * after what they set:
+ *
+ *   AGENT               share of the agent type, e.g. RESIDENTIAL
+ *   AGENT/LAND_USE      preference of the agent type towards the land use type
+ *
+ * for example
+ *
+ *   name,RESIDENTIAL,OFFICE,COM_SHOP,COM_CAFE,RESIDENTIAL/TRANSPORT
+ *   base,0.45,0.25,0.20,0.10,1
+ *   transit,0.45,0.25,0.20,0.10,4
+ *
+ * Values not given in the file, or left empty, keep the runtime scenario's
+ * preferences and the default percentages of the optimiser.
+ *
+ * Results are written as one columnar JSON object (writeSweepResults).
+ *
+ * Usage: Sweep_landuse <site.site|site.csv> <scenarios.csv> <results.json> [--threads N] [--seed S]
+ *
+ * The optimiser is compiled in from SimulatedAnnealing_landuse.cpp with its
+ * main() disabled. Enable _MAIN_ here and disable it there to build this
+ * program instead of the optimiser.
+ */
+
+//#define _MAIN_
+#ifdef _MAIN_
+
+#define LANDUSE_NO_MAIN
+#include "SimulatedAnnealing_landuse.cpp"
+
+#include <cstring>
+#include <sstream>
+
+// Function to split a CSV line into its fields, keeping empty fields
+vector<string> splitCsvLine(const string &line)
+{
+    vector<string> fields;
+    string field;
+    istringstream in(line);
+    while (getline(in, field, ','))
+    {
+        if (!field.empty() && field.back() == '\r')
+            field.pop_back();
+        fields.push_back(field);
+    }
+    if (!line.empty() && line.back() == ',')
+        fields.push_back("");
+    return fields;
+}
+
+// Function to look up a cell type by name, -1 if there is none
+int cellTypeByName(const string &name)
+{
+    auto it = find(begin(cellTypeNames), end(cellTypeNames), name);
+    return it == end(cellTypeNames) ? -1 : static_cast<int>(it - begin(cellTypeNames));
+}
+
+// Function to read the scenario table, starting every scenario from the
+// given defaults
+bool loadScenarios(const string &path, const SweepScenario &defaults, vector<SweepScenario> &scenarios, string &error)
+{
+    ifstream in(path);
+    string line;
+    if (!in || !getline(in, line))
+    {
+        error = "cannot read scenarios from " + path;
+        return false;
+    }
+
+    // What each column sets: an agent's share, or a preference (agent, land use index)
+    struct Column
+    {
+        CellType agent;
+        int landUse; // -1 for a share column
+    };
+    vector<Column> columns;
+    const vector<string> header = splitCsvLine(line);
+    for (size_t c = 1; c < header.size(); ++c)
+    {
+        const size_t slash = header[c].find('/');
+        const int agent = cellTypeByName(header[c].substr(0, slash));
+        int landUse = -1;
+        if (slash != string::npos)
+        {
+            const int type = cellTypeByName(header[c].substr(slash + 1));
+            auto it = find(landUseTypes.begin(), landUseTypes.end(), static_cast<CellType>(type));
+            landUse = type < 0 || it == landUseTypes.end() ? -2 : static_cast<int>(it - landUseTypes.begin());
+        }
+        if (agent < 0 || !isAgentType(static_cast<CellType>(agent)) || landUse == -2)
+        {
+            error = "unknown scenario column '" + header[c] + "'";
+            return false;
+        }
+        columns.push_back({static_cast<CellType>(agent), landUse});
+    }
+
+    for (int lineNumber = 2; getline(in, line); ++lineNumber)
+    {
+        if (line.empty() || line == "\r")
+            continue;
+
+        const vector<string> fields = splitCsvLine(line);
+        SweepScenario scenario = defaults;
+        scenario.name = fields[0];
+        for (size_t c = 1; c < fields.size() && c <= columns.size(); ++c)
+        {
+            if (fields[c].empty())
+                continue;
+            char *end = nullptr;
+            const double value = strtod(fields[c].c_str(), &end);
+            if (*end != '\0')
+            {
+                error = path + ":" + to_string(lineNumber) + ": invalid value '" + fields[c] + "'";
+                return false;
+            }
+            const Column &column = columns[c - 1];
+            if (column.landUse < 0)
+                scenario.agentPercentages[column.agent] = value;
+            else
+                scenario.preferences[column.agent][column.landUse] = static_cast<float>(value);
+        }
+        scenarios.push_back(scenario);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: " << argv[0] << " <site.site|site.csv> <scenarios.csv> <results.json> [--threads N] [--seed S]" << endl;
+        return 1;
+    }
+
+    SweepOptions options;
+    uint64_t seed = 1;
+    for (int i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            cerr << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    // Load the site, importing a .csv export first
+    string sitePath = argv[1];
+    string error;
+    if (sitePath.size() > 4 && sitePath.compare(sitePath.size() - 4, 4, ".csv") == 0)
+    {
+        const string csvPath = sitePath;
+        sitePath += ".site";
+        if (!importSiteCsv(csvPath, sitePath, siteDescription(), error))
+        {
+            cerr << "Import failed: " << error << endl;
+            return 1;
+        }
+    }
+    SiteFile siteFile;
+    Grid<CellType> site;
+    if (!siteFile.open(sitePath, error) || !loadSite(siteFile, site, error))
+    {
+        cerr << "Cannot load site: " << error << endl;
+        return 1;
+    }
+
+    SweepScenario defaults;
+    defaults.agentPercentages = {
+        {RESIDENTIAL, 0.45},
+        {OFFICE, 0.25},
+        {COM_SHOP, 0.20},
+        {COM_CAFE, 0.10}};
+    defaults.preferences = agentPreferences;
+
+    vector<SweepScenario> scenarios;
+    if (!loadScenarios(argv[2], defaults, scenarios, error))
+    {
+        cerr << error << endl;
+        return 1;
+    }
+
+    const auto start = steady_clock::now();
+    const vector<SweepResult> results = sweepScenarios(site, scenarios, seed, options);
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+
+    ofstream out(argv[3]);
+    writeSweepResults(out, results);
+    if (!out)
+    {
+        cerr << "Cannot write " << argv[3] << endl;
+        return 1;
+    }
+
+    cout << "Swept " << scenarios.size() << " scenarios on a " << site.rows() << "x" << site.cols()
+         << " site in " << seconds << " s" << endl;
+    return 0;
+}
+
+#endif
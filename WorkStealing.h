@@ -0,0 +1,85 @@
+/*
+ * Work-stealing parallel loop for batches of independent tasks of uneven
+ * cost, such as the anneals of a scenario sweep.
+ *
+ * parallelFor(count, threads, task) runs task(i) for every i in [0, count).
+ * Each worker starts with a contiguous share of the indices in its own
+ * deque and takes work from the back of it; a worker whose deque runs dry
+ * steals from the front of the others, so a few long tasks do not leave the
+ * remaining workers idle. No tasks are added while the loop runs, so a
+ * worker is done once every deque is empty.
+ *
+ * The deques are guarded by one mutex each. Tasks here run for milliseconds
+ * to seconds, so the lock is never contended enough to matter.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <typename Task>
+void parallelFor(int count, int threads, Task task)
+{
+    if (threads <= 0)
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, count));
+    if (count <= 0)
+        return;
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+    std::vector<WorkQueue> queues(threads);
+    for (int w = 0; w < threads; ++w)
+    {
+        const int first = static_cast<int>(static_cast<long long>(count) * w / threads);
+        const int last = static_cast<int>(static_cast<long long>(count) * (w + 1) / threads);
+        for (int i = first; i < last; ++i)
+            queues[w].tasks.push_back(i);
+    }
+
+    auto worker = [&](int w)
+    {
+        while (true)
+        {
+            int next = -1;
+            {
+                std::lock_guard<std::mutex> lock(queues[w].mutex);
+                if (!queues[w].tasks.empty())
+                {
+                    next = queues[w].tasks.back();
+                    queues[w].tasks.pop_back();
+                }
+            }
+
+            // Own deque is empty: steal the oldest task of another worker
+            for (int v = 1; next < 0 && v < threads; ++v)
+            {
+                WorkQueue &victim = queues[(w + v) % threads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty())
+                {
+                    next = victim.tasks.front();
+                    victim.tasks.pop_front();
+                }
+            }
+
+            if (next < 0)
+                return;
+            task(next);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int w = 1; w < threads; ++w)
+        workers.emplace_back(worker, w);
+    worker(0);
+    for (std::thread &t : workers)
+        t.join();
+}